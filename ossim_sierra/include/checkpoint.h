@@ -0,0 +1,31 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/* Checkpoint and restore of a whole simulation instance (-c, -r), see
+ * checkpoint.c. Checkpoints are taken and resumed by the sequential
+ * engine only, at the start of a slot: that is the one point where the
+ * state of every device is settled and the rest of the run does not
+ * depend on host scheduling. */
+
+struct os_ctx;
+struct cpu_args;
+struct loader_args;
+
+/* Write the state of [ctx] at the start of the current slot to [path] */
+int ckpt_save(struct os_ctx *ctx, const char *path, struct cpu_args *cpus,
+	      struct loader_args *ld);
+
+/* Open checkpoint [path] and load the configuration it was taken with
+ * into [ctx], in place of read_config() */
+int ckpt_open(struct os_ctx *ctx, const char *path);
+
+/* Load the rest of the opened checkpoint into the devices set up by
+ * os_run() and attach the ones that were still running to the timer.
+ * The RAM and swap images are mapped from the file, not read. Closes
+ * the checkpoint */
+int ckpt_load(struct os_ctx *ctx, struct cpu_args *cpus,
+	      struct loader_args *ld);
+
+void ckpt_close(struct os_ctx *ctx);
+
+#endif
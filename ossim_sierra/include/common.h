@@ -3,6 +3,7 @@
 
 /* Define structs and routine could be used by every source files */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -14,6 +15,8 @@
 #include "os-mm.h"
 #endif
 
+#include "rbtree.h"
+
 #define ADDRESS_SIZE 20
 #define OFFSET_LEN 10
 #define FIRST_LV_LEN 5
@@ -78,14 +81,38 @@ struct pcb_t {
 	struct code_seg_t *code; // Code segment
 	addr_t regs[10];	 // Registers, store address of allocated regions
 	uint32_t pc;		 // Program pointer, point to the next instruction
-	struct queue_t *ready_queue;
+	struct proc_heap *ready_queue;
 	struct queue_t *running_list;
+	int heap_idx;		// Position in the heap it is queued on, -1 if none
+	/* Processes of its name in the table of live processes, NULL while
+	 * not in it, and its entry among them, see sched_remove_procs() */
+	struct live_name *live;
+	int live_idx;
 #ifdef MLQ_SCHED
 	struct queue_t *mlq_ready_queue;
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
 	uint32_t prio;
+	uint32_t base_prio;	// prio of its config line
+	uint32_t boosts;	// MLFQ boosts it caught up with, see sched.c
+	uint64_t level_since;	// Slot it got to its current prio
+	int rq;			// MLQ run queue it was last queued on
+	atomic_int queued;	// RQ_* state on the rings of that run queue
 #endif
+	/* CFS policy (sched_cfs.c) */
+	struct rb_node cfs_node;	// Cleared while not on the tree
+	uint64_t vruntime;	// Weighted slots run, see cfs_tick()
+	uint64_t deadline;	// Absolute slot, UINT64_MAX for none
+	/* Placement */
+	uint64_t affinity;	// Bit per CPU it may run on, see proc_allowed()
+	int last_cpu;		// -1 until first dispatched
+	uint32_t migrations;	// Dispatches on another CPU than last_cpu
+	/* Timestamps and counters in slots, see latency.c */
+	uint64_t arrival;	// Loaded
+	uint64_t first_run;	// First dispatched, UINT64_MAX until then
+	uint64_t ready_since;	// Last queued
+	uint64_t wait;		// Spent queued so far
+	uint32_t switches;	// Dispatches
 #ifdef MM_PAGING
 	struct mm_struct *mm;
 	struct memphy_struct *mram;
@@ -0,0 +1,84 @@
+#ifndef EVLOG_H
+#define EVLOG_H
+
+/* Binary event log. Instead of formatting its output the simulator can
+ * append compact records to a file (-b); evdecode renders them back to
+ * the exact text the simulator would have printed. Every line printed
+ * on a hot path has its own event below. Page table and RAM dumps are
+ * logged as deltas against the previous dump and rebuilt by the
+ * decoder. Anything else falls back to a preformatted TEXT record.
+ *
+ * Stream: EVLOG_MAGIC, then records made of one type byte followed by
+ * the nargs zigzag varint arguments of the type and, for types with a
+ * string, a varint length and the bytes. */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define EVLOG_MAGIC "OSEVLOG1"
+
+/* name, nargs, has string, text format (NULL for state events) */
+#define OS_EVENTS(X)                                                        \
+	X(SLOT,       1, 0, "Time slot %3lu\n")                             \
+	X(LD_ROUTINE, 0, 0, "ld_routine\n")                                 \
+	X(LOAD,       2, 1, "\tLoaded a process at %s, PID: %ld PRIO: %ld\n") \
+	X(DISPATCH,   2, 0, "\tCPU %ld: Dispatched process %2ld\n")         \
+	X(PUT,        2, 0, "\tCPU %ld: Put process %2ld to run queue\n")   \
+	X(FINISH,     2, 0, "\tCPU %ld: Processed %2ld has finished\n")     \
+	X(STOP,       1, 0, "\tCPU %ld stopped\n")                          \
+	X(ALLOC_HDR,  0, 0, "===== PHYSICAL MEMORY AFTER ALLOCATION =====\n") \
+	X(ALLOC,      4, 0, "PID=%ld - Region=%ld - Address=%08lx - Size=%ld byte\n") \
+	X(ALLOC_FAIL, 3, 0, "ALLOCATION FAILED for PID=%ld Region=%ld Size=%ld\n") \
+	X(FREE_HDR,   0, 0, "===== PHYSICAL MEMORY AFTER DEALLOCATION =====\n") \
+	X(FREE,       2, 0, "PID=%ld - Region=%ld\n")                       \
+	X(READ_HDR,   0, 0, "===== PHYSICAL MEMORY AFTER READING =====\n")  \
+	X(READ,       3, 0, "read region=%ld offset=%ld value=%ld\n")       \
+	X(WRITE_HDR,  0, 0, "===== PHYSICAL MEMORY AFTER WRITING =====\n")  \
+	X(WRITE,      3, 0, "write region=%ld offset=%ld value=%ld\n")      \
+	X(SEPARATOR,  0, 0, "================================================================\n") \
+	X(TEXT,       0, 1, "%s")                                           \
+	X(RAM,        1, 0, NULL)	/* size */                          \
+	X(MEM,        2, 0, NULL)	/* addr, value */                   \
+	X(PTE,        3, 0, NULL)	/* pid, pgn, pte */                 \
+	X(PGTBL,      3, 0, NULL)	/* pid, start, end */               \
+	X(MEMDUMP,    0, 0, NULL)
+
+enum os_event_t {
+#define EV_ENUM(name, nargs, str, fmt) EV_##name,
+	OS_EVENTS(EV_ENUM)
+#undef EV_ENUM
+	EV_NR,
+};
+
+#define EV_MAX_ARGS 4
+
+extern const char * ev_fmt[EV_NR];
+extern const int ev_nargs[EV_NR];
+extern const int ev_has_str[EV_NR];
+
+/* Renderers shared by the simulator (text mode) and evdecode */
+void render_event(FILE * out, int ev, const long * args, const char * str);
+void render_pgtbl(FILE * out, uint32_t start, uint32_t end,
+		  const uint32_t * pgd);
+void render_memdump(FILE * out, const char * storage, int maxsz);
+
+/* Simulator side, see evlog.c. All of them go to the instance of the
+ * calling thread, as text, as records or nowhere */
+struct evlog;
+struct memphy_struct;
+struct mm_struct;
+
+void os_event(int ev, long a0, long a1, long a2, long a3);
+void os_event_str(int ev, const char * str, long a0, long a1);
+
+struct evlog * evlog_open(const char * path);
+void evlog_close(struct evlog * log);
+void evlog_text(struct evlog * log, const char * fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void evlog_set_ram(struct evlog * log, struct memphy_struct * ram);
+void evlog_mem(struct evlog * log, struct memphy_struct * mp, int addr,
+	       char value);
+void evlog_pgtbl(struct evlog * log, uint32_t pid, const uint32_t * pgd,
+		 uint32_t start, uint32_t end);
+
+#endif
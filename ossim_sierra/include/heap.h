@@ -0,0 +1,72 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+/* Indexed binary min-heap of processes, see heap.c. Processes come out
+ * by key, and equal keys first in, first out. A queued process keeps
+ * its position in the heap in heap_idx, which serves as its handle:
+ * taking it out from anywhere costs O(log n) instead of a scan. The
+ * heap grows as needed and is not thread safe. */
+
+#include <stdint.h>
+
+struct pcb_t;
+
+struct heap_ent {
+	uint64_t key;
+	uint64_t seq;		/* Breaks ties, in the order queued */
+	struct pcb_t * proc;
+};
+
+struct proc_heap {
+	struct heap_ent * ent;
+	int nr;
+	int cap;
+	uint64_t seq;		/* For the next process queued */
+};
+
+void heap_init(struct proc_heap * h);
+
+/* Frees the entries, not the processes */
+void heap_free(struct proc_heap * h);
+
+/* O(log n) */
+void heap_push(struct proc_heap * h, struct pcb_t * proc, uint64_t key);
+
+/* heap_push() with a given [seq], as when restoring a checkpoint */
+void heap_insert(struct proc_heap * h, struct pcb_t * proc, uint64_t key,
+		 uint64_t seq);
+
+/* The first process, NULL if none. O(1) */
+struct pcb_t * heap_first(const struct proc_heap * h);
+
+/* Takes out the first process, NULL if none. O(log n) */
+struct pcb_t * heap_pop(struct proc_heap * h);
+
+/* Whether [proc] is on [h]. O(1) */
+int heap_has(const struct proc_heap * h, const struct pcb_t * proc);
+
+/* Takes [proc] out, wherever it is. O(log n). Returns 0 if it was not
+ * on [h] */
+int heap_remove(struct proc_heap * h, struct pcb_t * proc);
+
+/* Takes those of the [n] processes of [procs] that are on [h] out.
+ * Returns how many. O(k log n) for k of them, or O(n) once rebuilding
+ * the heap costs less */
+int heap_remove_many(struct proc_heap * h, struct pcb_t ** procs, int n);
+
+/* The first process [ok] accepts, NULL if none. Subtrees whose root
+ * orders after the best match so far are skipped */
+struct pcb_t * heap_find(const struct proc_heap * h,
+			 int (*ok)(const struct pcb_t *, const void *),
+			 const void * arg);
+
+/* Same, among the processes of key [limit] at most */
+struct pcb_t * heap_find_upto(const struct proc_heap * h, uint64_t limit,
+			      int (*ok)(const struct pcb_t *, const void *),
+			      const void * arg);
+
+static inline int heap_empty(const struct proc_heap * h) {
+	return h->nr == 0;
+}
+
+#endif
@@ -145,6 +145,7 @@ int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
 int MEMPHY_dump(struct memphy_struct * mp);
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
+void free_memphy(struct memphy_struct *mp);
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
@@ -0,0 +1,272 @@
+#ifndef OSCTX_H
+#define OSCTX_H
+
+/* Simulation instance. Everything a running simulation owns lives here
+ * instead of in file-static variables, so that several instances can
+ * run side by side in one host process (see sweep.c). */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "evlog.h"
+#include "heap.h"
+#include "queue.h"
+#include "sched.h"
+#include "timer.h"
+#include "trace.h"
+
+#ifdef MLQ_SCHED
+/* MLQ run queue, shared by all CPUs or one per CPU. Lock-free, see
+ * sched.c */
+struct mlq_rq {
+	struct ring_t mlq_ready_queue[MAX_PRIO];
+	atomic_int slot_usage[MAX_PRIO];
+	/* One bit per level: ring not empty, slots left this round */
+	_Atomic uint64_t nonempty[PRIO_WORDS];
+	_Atomic uint64_t has_slot[PRIO_WORDS];
+	/* Processes killed while queued that are still on each ring, see
+	 * mlq_unqueue() */
+	atomic_int dead[MAX_PRIO];
+	atomic_int nr;		/* Processes queued, not counting those */
+	unsigned int picks;	/* Dispatches by the owning CPU */
+	unsigned int seed;	/* Of the peers it pulls and steals from */
+	/* MLFQ: earliest slot a process queued at each level may be aged
+	 * at, SLOT_NEVER for none. Only a hint, see mlfq_pass() */
+	_Atomic uint64_t age_due[MAX_PRIO];
+};
+#endif
+
+/* Scheduler queues, see sched.c */
+struct sched_state {
+	struct proc_heap ready_queue;	/* fifo, by priority */
+	struct proc_heap run_queue;
+	struct queue_t running_list;
+	pthread_mutex_t queue_lock;
+#ifdef MLQ_SCHED
+	int slot[MAX_PRIO];
+	struct mlq_rq *rq;
+	int nr_rq;		/* 1, or num_cpus with percpu_rq */
+	int next_rq;		/* Where the loader looks first */
+	int place_rq;		/* Where it puts the next process, -1 for
+				 * the least loaded (sched_place()) */
+	/* MLFQ (mlfq), see sched.c */
+	int mlfq_step;		/* Priorities per level */
+	int mlfq_age;		/* Slots, 0 for no aging */
+	int mlfq_boost;		/* Slots between boosts, 0 for none */
+	_Atomic uint64_t mlfq_next_pass; /* Slot of the next aging pass */
+	uint64_t mlfq_next_boost;
+	atomic_uint mlfq_boosts;	/* Boosts so far */
+	atomic_ulong mlfq_demotions;
+	atomic_ulong mlfq_promotions;	/* By aging */
+	atomic_ulong residency[MAX_PRIO]; /* Slots processes spent at each
+					   * level, queued or running */
+#endif
+	/* CFS, under queue_lock */
+	struct rb_root cfs_tree;	/* Runnable processes by vruntime */
+	uint64_t min_vruntime;		/* Never decreases */
+	/* EDF, under queue_lock */
+	struct proc_heap edf_heap;	/* By deadline */
+	/* Quantum of each level, see sched_quantum() */
+	int quantum[MAX_PRIO];
+	struct quantum_window {
+		int ends;	/* Quanta ended since the last adjustment */
+		int expired;	/* Of which used up */
+		int depth;	/* Processes queued at the level, summed */
+	} qwin[MAX_PRIO];
+	pthread_mutex_t quantum_lock;
+};
+
+struct ld_args {
+	char **path;
+	unsigned long *start_time;
+#ifdef MLQ_SCHED
+	unsigned long *prio;
+#endif
+	unsigned long *deadline;	/* Relative to loading, 0 for none */
+	uint64_t *affinity;		/* AFFINITY_ANY for none */
+};
+
+/* Engine state of the simulated devices, owned by os_run() (os.c) and
+ * saved with the rest of the instance by checkpoint.c */
+struct loader_args {
+	/* A dispatched argument struct to compact many-fields passing to loader */
+	struct os_ctx *ctx;
+	struct timer_id_t *timer_id;
+#ifdef MM_PAGING
+	int vmemsz;
+	struct memphy_struct *mram;
+	struct memphy_struct **mswp;
+	struct memphy_struct *active_mswp;
+	int active_mswp_id;
+#endif
+};
+
+struct cpu_args {
+	struct os_ctx *ctx;
+	struct timer_id_t *timer_id;	/* NULL once stopped */
+	int id;
+	/* Execution state, kept here rather than on the stack of the CPU
+	 * thread so that any host thread can step this CPU */
+	struct pcb_t *proc;
+	int time_left;
+	uint64_t resume;	/* First slot not run ahead yet */
+};
+
+/* What the other devices see of a CPU, to preempt it on arrival (-p)
+ * or to wake it up once parked */
+struct cpu_view {
+	_Atomic uint64_t rank;	/* sched_ops.rank of its process, or
+				 * RANK_IDLE */
+	atomic_int preempt;	/* Requeue its process at its next step */
+	struct timer_id_t *timer_id;
+};
+
+/* Lateness of the processes that had a deadline, in slots: 0 (met),
+ * 1, 2-3, 4-7, ..., the last bucket open ended */
+#define LATENESS_BUCKETS 16
+
+/* Counters reported by the sweep summary */
+struct os_stats {
+	atomic_ulong busy_slots;	/* CPU slots spent running a process */
+	atomic_ulong idle_slots;	/* CPU slots without a process */
+	atomic_ulong idle_ready;	/* Of which processes were queued */
+	atomic_ulong dispatches;
+	atomic_ulong finished;
+	atomic_ulong alloc_fails;
+	atomic_ulong page_faults;
+	atomic_ulong lateness[LATENESS_BUCKETS];
+	atomic_ulong total_lateness;
+	atomic_ulong max_lateness;
+	atomic_ulong migrations;
+	atomic_ulong preemptions;	/* Processes requeued for an arrival */
+};
+
+/* What a process leaves behind when it finishes, in slots */
+struct proc_stat {
+	int finished;
+	uint32_t prio;
+	uint64_t arrival;
+	uint64_t response;	/* Loaded to first dispatched */
+	uint64_t wait;		/* Spent queued */
+	uint64_t turnaround;	/* Loaded to finished */
+	uint32_t switches;	/* Dispatches */
+	uint32_t migrations;
+};
+
+/* Live processes of one name, in a bucket of the table killall looks
+ * in (see sched_remove_procs()). Entries stay in the order added; one
+ * that left is a hole, proc NULL, until holes are half of them */
+struct live_ent {
+	uint32_t pid;
+	struct pcb_t *proc;
+};
+
+struct live_name {
+	struct live_name *next;		/* In its bucket */
+	struct live_ent *ent;
+	int nr;				/* Entries, holes included */
+	int holes;
+	int cap;
+	char path[100];
+};
+
+struct os_ctx {
+	/* Configuration */
+	int time_slot;
+	int num_cpus;
+	int num_processes;
+#ifdef MM_PAGING
+	int memramsz;
+	int memswpsz[PAGING_MAX_MMSWP];
+#endif
+	struct ld_args ld_processes;
+	int lookahead;		/* CPUs run ahead through local code */
+	int workers;		/* Host threads of the M:N engine, 0 for
+				 * one thread per CPU */
+	int percpu_rq;		/* One MLQ run queue per CPU (-q) */
+	const struct sched_ops *sched_ops;	/* Policy */
+	int warm_tol;		/* Warm CPU tolerance (-a), -1 for none */
+	int has_affinity;	/* Some process has an affinity mask */
+	int preempt;		/* Preempt on arrival (-p) */
+	int quantum[MAX_PRIO];	/* Of each level (-Q), 0 for time_slot */
+	int adaptive_quantum;	/* Adjust them as the run goes (-Q) */
+	int quantum_set;	/* -Q was given, over the config file */
+	int mlfq_step;		/* MLFQ priorities per level, aging and
+				 * boost periods in slots (0 for none), -1
+				 * for the defaults */
+	int mlfq_age;
+	int mlfq_boost;
+
+	/* Loader progress */
+	int ld_next;		/* Index of the next process to be loaded */
+	atomic_int done;	/* Every process has been loaded */
+	int park;		/* Idle CPUs leave the slot barrier */
+	atomic_int parked;	/* CPUs parked right now */
+	uint32_t avail_pid;
+	/* Live processes by name, from add_proc() until they finish or are
+	 * killed. The lock keeps a process from being freed while killall
+	 * looks at it */
+	struct live_name **live;
+	unsigned int live_mask;	/* Buckets, a power of two, less one */
+	pthread_mutex_t live_lock;
+
+	struct timer_state timer;
+	struct sched_state sched;
+	pthread_mutex_t mmvm_lock;
+
+	/* Simulation output, NULL to run silently or to log events */
+	FILE *out;
+	struct evlog *evlog;
+	struct os_stats stats;
+	struct proc_stat *procstat;	/* By pid */
+	struct cpu_view *cpus;		/* By CPU id */
+	const char *metrics_path;	/* -m, NULL for no report */
+	struct trace_state *trace;	/* NULL when not tracing */
+	struct rr_state *rr;		/* NULL unless recording or replaying */
+
+	/* Checkpoint to take (-c), SLOT_NEVER for none */
+	uint64_t ckpt_slot;
+	const char *ckpt_path;
+	struct ckpt *restore;	/* Checkpoint to resume from (-r) */
+};
+
+/* Instance the calling host thread is working for. Every thread taking
+ * part in a simulation sets it before touching any simulated state */
+extern __thread struct os_ctx *cur_ctx;
+
+#define os_printf(...)                                          \
+	do {                                                    \
+		if (cur_ctx->out != NULL)                       \
+			fprintf(cur_ctx->out, __VA_ARGS__);     \
+		else if (cur_ctx->evlog != NULL)                \
+			evlog_text(cur_ctx->evlog, __VA_ARGS__); \
+	} while (0)
+
+struct os_ctx *os_ctx_create(void);
+void os_ctx_destroy(struct os_ctx *ctx);
+int read_config(struct os_ctx *ctx, const char *path);
+struct os_ctx *os_ctx_clone(const struct os_ctx *ctx);
+
+/* Run a configured instance to completion, in the calling thread when
+ * [sequential] is set or on one host thread per simulated CPU */
+void os_run(struct os_ctx *ctx, int sequential);
+
+/* Wake up a parked CPU that may run a process the calling device
+ * queued, last run on [last_cpu] (-1 for any) and with [affinity], or
+ * any parked CPU for AFFINITY_ANY. They are passed by value, as the
+ * process may already run or be killed and freed by then. No-op unless
+ * idle CPUs park */
+void wake_idle_cpu(int last_cpu, uint64_t affinity);
+
+/* Print the wait, response and turnaround times of the finished
+ * processes, overall and by priority level, and write them with their
+ * histograms to metrics_path (latency.c) */
+void latency_report(struct os_ctx *ctx);
+
+/* Run every variant of [base] described by [spec] on [jobs] host
+ * threads and print one summary line per variant (sweep.c) */
+int run_sweep(const struct os_ctx *base, const char *spec, int jobs);
+
+#endif
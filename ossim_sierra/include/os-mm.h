@@ -78,6 +78,9 @@ struct memphy_struct {
    int rdmflg;
    int cursor;
 
+   /* Storage is a private mapping of a checkpoint, not malloc'ed */
+   int mapped;
+
    /* Management structure */
    struct framephy_struct *free_fp_list;
    struct framephy_struct *used_fp_list;
@@ -3,19 +3,81 @@
 #define QUEUE_H
 
 #include "common.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
 
-#define MAX_QUEUE_SIZE 10
-
+/* Unbounded FIFO of processes: a ring buffer that doubles when full.
+ * Not thread safe, its owner serializes the calls. A zeroed queue is
+ * empty and ready for use */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t ** proc;	/* cap slots, the first at head */
+	int head;
 	int size;
+	int cap;
 };
 
+void queue_init(struct queue_t * q);
+
+/* Frees the slots, not the processes */
+void queue_free(struct queue_t * q);
+
+/* O(1), amortized */
 void enqueue(struct queue_t * q, struct pcb_t * proc);
 
-struct pcb_t * dequeue(struct queue_t * q);
+/* The oldest process, O(1) */
+struct pcb_t * queue_pop(struct queue_t * q);
+
+/* The [i]th process from the head */
+struct pcb_t * queue_at(struct queue_t * q, int i);
+
+/* Removes the [i]th process from the head and returns it */
+struct pcb_t * queue_remove_at(struct queue_t * q, int i);
 
 int empty(struct queue_t * q);
 
+/* FIFO of processes that any number of threads may push to and pop from
+ * at once. The first ones queued sit in lock-free cells, as many as the
+ * ring was created with; past that, pushes spill over into a queue_t
+ * under a lock until the cells have room again (see queue.c). A ring
+ * holding more processes than it has cells takes that lock on every
+ * push and pop, so it is to be sized for the processes it may hold at
+ * once. Cells cost 16 bytes each, and a ring has between RING_MIN_CELLS
+ * and RING_MAX_CELLS of them */
+#define RING_MIN_CELLS 16
+#define RING_MAX_CELLS 1024
+
+struct ring_cell_t {
+	atomic_size_t seq;
+	struct pcb_t * proc;
+};
+
+struct ring_t {
+	_Alignas(64) atomic_size_t head;	/* Next cell to pop */
+	_Alignas(64) atomic_size_t tail;	/* Next cell to push */
+	struct ring_cell_t * cell;
+	size_t cells;		/* A power of two */
+	_Alignas(64) atomic_int spilled;	/* spill.size */
+	pthread_mutex_t spill_lock;
+	struct queue_t spill;	/* Pushed after the cells, in order */
+};
+
+/* Room in the cells for [procs] processes, rounded up to a power of
+ * two within the bounds above */
+void ring_init(struct ring_t * r, int procs);
+
+void ring_destroy(struct ring_t * r);
+
+void ring_push(struct ring_t * r, struct pcb_t * proc);
+
+/* Returns NULL if the ring is empty */
+struct pcb_t * ring_pop(struct ring_t * r);
+
+/* Processes queued. Only a hint while other threads push or pop */
+int ring_size(struct ring_t * r);
+
+/* The [i]th process from the head. Only while nobody pushes or pops */
+struct pcb_t * ring_peek(struct ring_t * r, int i);
+
 #endif
 
@@ -0,0 +1,54 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+/* Intrusive red-black tree, see rbtree.c. Nodes are embedded in the
+ * objects they order and the tree never allocates; the leftmost node
+ * is cached, so taking the smallest element costs O(1) plus the
+ * O(log n) erase. */
+
+#include <stddef.h>
+
+struct rb_node {
+	struct rb_node * parent;
+	struct rb_node * left;
+	struct rb_node * right;
+	int red;
+};
+
+struct rb_root {
+	struct rb_node * root;
+	struct rb_node * first;	/* Leftmost node, NULL when empty */
+};
+
+#define RB_ROOT_INIT ((struct rb_root){NULL, NULL})
+
+#define rb_entry(node, type, member) \
+	((type *)((char *)(node) - offsetof(type, member)))
+
+/* Insert [node] after every node that does not order after it, so that
+ * equal keys come out first in, first out. [less] tells whether [a]
+ * orders before [b] */
+void rb_insert(struct rb_root * t, struct rb_node * node,
+	       int (*less)(const struct rb_node * a, const struct rb_node * b));
+
+/* Leaves [node] unlinked, see rb_linked() */
+void rb_erase(struct rb_root * t, struct rb_node * node);
+
+/* In-order successor of [node], NULL for the last one */
+struct rb_node * rb_next(const struct rb_node * node);
+
+/* Mark [node] as in no tree, as a node is before its first rb_insert() */
+static inline void rb_clear(struct rb_node * node) {
+	node->parent = node;
+}
+
+/* Whether [node] is in a tree, in O(1) */
+static inline int rb_linked(const struct rb_node * node) {
+	return node->parent != node;
+}
+
+static inline int rb_empty(const struct rb_root * t) {
+	return t->root == NULL;
+}
+
+#endif
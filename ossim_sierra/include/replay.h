@@ -0,0 +1,35 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/* Record and replay of the nondeterministic choices of a threaded run
+ * (-R, -P), see replay.c. Every step of a device (a CPU or the loader)
+ * is one section: recording runs the sections one at a time and logs
+ * in which order the devices entered them, replaying makes the devices
+ * enter them in the logged order again. The processes handed out by
+ * get_proc() and the frames handed out by MEMPHY_get_freefp() are
+ * logged as well, and checked on replay. */
+
+struct os_ctx;
+
+enum rr_kind_t {
+	RR_STEP,	/* A device entered a section */
+	RR_PROC,	/* get_proc() returned this pid, 0 for none */
+	RR_FRAME,	/* MEMPHY_get_freefp() returned this fpn + 1, 0 for none */
+};
+
+int rr_record(struct os_ctx *ctx, const char *path);
+int rr_replay(struct os_ctx *ctx, const char *path);
+
+/* Flush the log, or report a replay that ended early. Returns -1 if the
+ * replay diverged from the log */
+int rr_finish(struct os_ctx *ctx);
+
+/* Bracket the step of device [dev] (CPU id, the loader is num_cpus).
+ * No-ops unless recording or replaying */
+void rr_enter(int dev);
+void rr_exit(void);
+
+/* Log, or check against the log, a choice made inside a section */
+void rr_value(enum rr_kind_t kind, unsigned long value);
+
+#endif
@@ -1,5 +1,5 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
@@ -8,12 +8,152 @@
 #endif
 
 #define MAX_PRIO 140
+#define PRIO_WORDS ((MAX_PRIO + 63) / 64)
+
+/* Scheduling policy of an instance, named on the first line of its
+ * config file (see read_config()). The hooks work on the instance of
+ * cur_ctx; the ones marked optional may be NULL */
+struct sched_ops {
+	const char *name;
+	void (*init)(void);			/* Optional */
+	void (*finish)(void);			/* Optional */
+	/* Next process to dispatch, NULL if none is runnable */
+	struct pcb_t *(*pick_next)(void);
+	/* Queue a process just loaded */
+	void (*enqueue)(struct pcb_t *proc);
+	/* Queue a process back at the end of its quantum */
+	void (*requeue)(struct pcb_t *proc);
+	/* [proc] ran one slot. Optional; may touch nothing but [proc], as it
+	 * also runs for the slots a CPU runs ahead (-l) */
+	void (*tick)(struct pcb_t *proc);
+	/* [proc] finished, right before it is freed. Optional */
+	void (*on_exit)(struct pcb_t *proc);
+	/* [proc] used up its quantum, before it keeps its CPU or goes back
+	 * to the queues. Optional */
+	void (*expire)(struct pcb_t *proc);
+	/* Whether [proc], at the end of its quantum, should run another one
+	 * on the same CPU rather than go back to the queues, as nothing
+	 * queued beats it by more than the warm tolerance (-a). Called by
+	 * that CPU, only with -a. Optional */
+	int (*keep)(struct pcb_t *proc);
+	/* Urgency of [proc] for preemption on arrival (-p), the lower the
+	 * more urgent, below RANK_IDLE. Optional: the policy never
+	 * preempts without it */
+	uint64_t (*rank)(const struct pcb_t *proc);
+	/* Processes queued at level [prio], for the adaptive quantum.
+	 * Optional: quanta do not adapt without it */
+	int (*depth)(int prio);
+	/* Nothing queued */
+	int (*empty)(void);
+	/* Take those of the [n] processes of [procs] that are queued off
+	 * the queues, wherever they wait, at once, and move them to the
+	 * front of [procs] in the same order. Returns how many; the others
+	 * run (see sched_remove_procs()) */
+	int (*unqueue)(struct pcb_t **procs, int n);
+};
+
+extern const struct sched_ops fifo_sched_ops;
+extern const struct sched_ops cfs_sched_ops;	/* sched_cfs.c */
+extern const struct sched_ops edf_sched_ops;	/* sched_edf.c */
+#ifdef MLQ_SCHED
+extern const struct sched_ops mlq_sched_ops;
+extern const struct sched_ops mlfq_sched_ops;
+#define DEFAULT_SCHED_OPS (&mlq_sched_ops)
+#else
+#define DEFAULT_SCHED_OPS (&fifo_sched_ops)
+#endif
+
+/* Affinity of a process that may run anywhere. Only CPUs 0-63 can be
+ * named in a mask; a process with a mask never runs on the others, nor
+ * outside of a CPU (cur_cpu of -1) */
+#define AFFINITY_ANY UINT64_MAX
+
+static inline int cpu_allowed(uint64_t affinity, int cpu) {
+	return affinity == AFFINITY_ANY ||
+		(cpu >= 0 && cpu < 64 && (affinity >> cpu) & 1);
+}
+
+static inline int proc_allowed(const struct pcb_t *proc, int cpu) {
+	return cpu_allowed(proc->affinity, cpu);
+}
+
+/* Priority level of [proc] in this build */
+static inline uint32_t proc_prio(const struct pcb_t *proc) {
+#ifdef MLQ_SCHED
+	return proc->prio;
+#else
+	return proc->priority;
+#endif
+}
+
+/* CPU the calling host thread is stepping, -1 while it steps none (the
+ * loader). Set by cpu_step() (os.c), for the policies to tell which
+ * run queue or affinity applies */
+extern __thread int cur_cpu;
+
+/* Rank of a CPU running nothing */
+#define RANK_IDLE UINT64_MAX
+
+/* Policy called [name], NULL if there is none */
+const struct sched_ops *sched_find(const char *name);
 
 int queue_empty(void);
 
 void init_scheduler(void);
 void finish_scheduler(void);
 
+/* Take every queued process named [path] off the ready queues, hand it
+ * to [drop], in pid order, then free it. Processes on a CPU are left
+ * alone */
+void sched_remove_procs(const char *path, void (*drop)(struct pcb_t *));
+
+/* Enter [proc] in the table of live processes sched_remove_procs()
+ * looks in, as add_proc() does (checkpoint restore) */
+void sched_add_live(struct pcb_t *proc);
+
+/* The process running on a CPU spent one more slot, or is done. Once
+ * done, it leaves the table of live processes */
+void sched_tick(struct pcb_t *proc);
+void sched_exit(struct pcb_t *proc);
+
+/* Quantum of the level of [proc], in slots */
+int sched_quantum(const struct pcb_t *proc);
+
+/* [proc] came to the end of a quantum: [expired] if it used it all up
+ * and goes back to the queues, 0 if it finished. Feeds the adaptive
+ * quantum (-Q adaptive) */
+void sched_quantum_end(const struct pcb_t *proc, int expired);
+
+/* [proc] used up its quantum (see sched_ops.expire) */
+void sched_expire(struct pcb_t *proc);
+
+/* Have the loader queue its next process where CPU [cpu] takes its
+ * processes from, rather than on the least loaded run queue (-q) */
+void sched_place(int cpu);
+
+/* Whether the process running on the calling CPU keeps it for another
+ * quantum (see sched_ops.keep). Always 0 without -a */
+int sched_keep(struct pcb_t *proc);
+
+/* Queue [proc] on the CFS tree under the vruntime it has (checkpoint
+ * restore) */
+void cfs_insert(struct pcb_t *proc);
+
+#ifdef MLQ_SCHED
+struct mlq_rq;
+
+/* States of pcb_t.queued, see mlq_unqueue() */
+#define RQ_NONE 0	/* Off the rings: on a CPU, or on its way */
+#define RQ_QUEUED 1	/* On a ring, up for dispatch */
+#define RQ_KILLED 2	/* Killed on a ring, held by the ring and the killer */
+#define RQ_ORPHAN 3	/* Killed, let go of by one of those two */
+
+/* Rebuild the level bitmaps and counts of [rq], and the run queue
+ * handles of the processes on it, after its queues or slot counts were
+ * changed behind the scheduler's back (checkpoint restore) */
+void sched_sync_rq(struct mlq_rq *rq);
+#endif
+
 /* Get the next process from ready queue */
 struct pcb_t * get_proc(void);
 
@@ -2,15 +2,34 @@
 #define TIMER_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
+/* Wakeup slot of a device that only waits for other devices */
+#define SLOT_NEVER UINT64_MAX
+
 struct timer_id_t {
 	int done;
 	int fsh;
-	pthread_cond_t event_cond;
-	pthread_mutex_t event_lock;
-	pthread_cond_t timer_cond;
-	pthread_mutex_t timer_lock;
+};
+
+/* Longest lookahead a device can announce, in slots */
+#define TIMER_AHEAD_SLOTS 64
+
+/* Per-instance timer, see timer.c for the slot barrier protocol */
+struct timer_state {
+	struct timer_id_container_t * dev_list;
+	uint64_t time;
+	int started;
+	int fast_forward;
+	int spin;		/* Busy-wait budget before parking */
+
+	atomic_int active;	/* Devices not yet detached */
+	atomic_int remaining;	/* Arrivals missing in this slot */
+	atomic_uint gen;	/* Slot generation */
+	atomic_int idle;	/* Idle arrivals in this slot */
+	_Atomic uint64_t wakeup; /* Earliest wakeup of the idle ones */
+	atomic_int ahead[TIMER_AHEAD_SLOTS]; /* Arrived in advance, by slot */
 };
 
 void start_timer();
@@ -23,6 +42,34 @@ void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
+/* Same as next_slot() for a device that has nothing to do until slot
+ * [wakeup]. Only used as a hint by the fast-forward mode */
+void next_slot_idle(struct timer_id_t* timer_id, uint64_t wakeup);
+
+/* Same as next_slot() for a device whose next [k] slots are already
+ * done: the barrier does not wait for it before slot now + k + 1.
+ * [k] must be below TIMER_AHEAD_SLOTS */
+void next_slot_ahead(struct timer_id_t* timer_id, int k);
+
+/* Leave the barrier while idle, see timer.c. park_event() announces
+ * the device, next_slot_park() takes it out after it arrived in the
+ * current slot and returns, in the slot it is to step in, once
+ * unpark_event() brought it back, with the number of slots it missed.
+ * unpark_event() returns 0 if the device was not parked, or already
+ * brought back */
+void park_event(struct timer_id_t* timer_id);
+unsigned int next_slot_park(struct timer_id_t* timer_id);
+int unpark_event(struct timer_id_t* timer_id);
+
+void set_fast_forward(int enable);
+
+/* Arrival halves of next_slot() and next_slot_idle(), without the wait.
+ * For engines stepping several devices from one host thread: the slot
+ * is closed by whichever call is the last arrival */
+void slot_done(struct timer_id_t* timer_id);
+void slot_idle(struct timer_id_t* timer_id, uint64_t wakeup);
+void slot_ahead(struct timer_id_t* timer_id, int k);
+
 uint64_t current_time();
 
 #endif
@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Static tracepoints. Each one costs a load and a not-taken branch
+ * while disabled. Enabled ones append a fixed-size record to the ring
+ * of the device (CPU or loader) the calling thread is stepping; a
+ * collector thread drains the rings to the trace file. See trace.c */
+
+#include <stdint.h>
+
+/* name, format of the three arguments */
+#define TRACE_POINTS(X)                                         \
+	X(slot,     "time=%lu active=%lu idle=%lu")              \
+	X(get_proc, "pid=%lu prio=%lu")                          \
+	X(put_proc, "pid=%lu prio=%lu")                          \
+	X(dispatch, "pid=%lu time_left=%lu")                     \
+	X(finish,   "pid=%lu")                                   \
+	X(insn,     "pid=%lu pc=%lu opcode=%lu")                 \
+	X(alloc,    "pid=%lu rgid=%lu size=%lu")                 \
+	X(free,     "pid=%lu rgid=%lu")                          \
+	X(pgfault,  "pid=%lu pgn=%lu victim=%lu")                \
+	X(load,     "pid=%lu prio=%lu")
+
+enum trace_point_t {
+#define TRACE_ENUM(name, fmt) TP_##name,
+	TRACE_POINTS(TRACE_ENUM)
+#undef TRACE_ENUM
+	TP_NR,
+};
+
+/* Fixed-size ring entry */
+struct trace_rec {
+	uint64_t time;
+	uint16_t tp;
+	uint16_t dev;
+	uint32_t a0;
+	uint64_t a1;
+	uint64_t a2;
+};
+
+extern unsigned char trace_on[TP_NR];
+
+/* Device whose ring the calling thread writes to */
+extern __thread int trace_dev;
+
+#define trace(name, a0, a1, a2)                                         \
+	do {                                                            \
+		if (__builtin_expect(trace_on[TP_##name], 0))           \
+			trace_emit(TP_##name, (a0), (a1), (a2));        \
+	} while (0)
+
+void trace_emit(int tp, uint32_t a0, uint64_t a1, uint64_t a2);
+
+/* Enable the comma separated tracepoints of [list] ("all" for every
+ * one). Returns -1 on an unknown name */
+int trace_enable(const char * list);
+int trace_enabled(void);
+
+struct os_ctx;
+
+/* Allocate one ring per device of [ctx] and start the collector,
+ * writing to [path] (stderr when NULL) */
+int trace_start(struct os_ctx * ctx, const char * path);
+
+/* Drain what is left, stop the collector and release the rings */
+void trace_stop(struct os_ctx * ctx);
+
+#endif
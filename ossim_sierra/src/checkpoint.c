@@ -0,0 +1,1105 @@
+#include "checkpoint.h"
+#include "mm.h"
+#include "os-ctx.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* File layout: a header, the metadata section, then the storage of the
+ * RAM and of every swap device, each starting on a page boundary so
+ * that a restore maps it straight from the file (private, copy on
+ * write) instead of reading it.
+ *
+ * The metadata is a flat stream of native fields in a fixed order:
+ * configuration, loader progress and timer, the processes, the CPUs,
+ * the scheduler queues of every policy and the frame lists of the
+ * memory devices.
+ * Pointers between simulated objects are saved as indexes: processes
+ * by their position in the process section, swap devices by number.
+ * A checkpoint is only meant to be restored by the build that took it;
+ * the header records the build constants the layout depends on. */
+
+#define CKPT_MAGIC "OSCKPT15"
+#define CKPT_NDEV (1 + PAGING_MAX_MMSWP)	/* RAM, then the swaps */
+
+struct ckpt_header {
+	char magic[8];
+	uint32_t hdr_size;
+	uint32_t max_prio;
+	uint32_t max_pgn;
+	uint32_t symtbl_sz;
+	uint32_t ahead_slots;
+	uint64_t meta_off;
+	uint64_t meta_size;
+	uint64_t storage_off[CKPT_NDEV];
+};
+
+/* Metadata being written */
+struct ckpt_out {
+	char * buf;
+	size_t len;
+	size_t cap;
+};
+
+/* Metadata being read, straight from the mapped file */
+struct ckpt_in {
+	const char * p;
+	const char * end;
+	int err;
+};
+
+/* An opened checkpoint, see ckpt_open() */
+struct ckpt {
+	int fd;
+	char * map;
+	size_t size;
+	const struct ckpt_header * hdr;
+	struct ckpt_in in;	/* Past the configuration */
+};
+
+static void put(struct ckpt_out * o, const void * p, size_t n) {
+	if (o->len + n > o->cap) {
+		while (o->len + n > o->cap) {
+			o->cap = o->cap ? o->cap * 2 : 4096;
+		}
+		o->buf = realloc(o->buf, o->cap);
+	}
+	memcpy(o->buf + o->len, p, n);
+	o->len += n;
+}
+
+static void put_u32(struct ckpt_out * o, uint32_t v) {
+	put(o, &v, sizeof(v));
+}
+
+#define PUT(o, v) put(o, &(v), sizeof(v))
+
+static void get(struct ckpt_in * in, void * p, size_t n) {
+	if (in->err || (size_t)(in->end - in->p) < n) {
+		in->err = 1;
+		memset(p, 0, n);
+		return;
+	}
+	memcpy(p, in->p, n);
+	in->p += n;
+}
+
+static uint32_t get_u32(struct ckpt_in * in) {
+	uint32_t v;
+	get(in, &v, sizeof(v));
+	return v;
+}
+
+#define GET(in, v) get(in, &(v), sizeof(v))
+
+/* Element count of an array of [elsz] bytes each, which must still fit
+ * in the stream, so that a damaged file cannot make us allocate more
+ * than its own size */
+static uint32_t get_count(struct ckpt_in * in, size_t elsz) {
+	uint32_t n = get_u32(in);
+	if (elsz > 0 && n > (size_t)(in->end - in->p) / elsz) {
+		in->err = 1;
+		return 0;
+	}
+	return n;
+}
+
+/* Index of [proc] in the process table, -1 for none */
+static int32_t proc_index(struct pcb_t ** procs, int nprocs,
+			  struct pcb_t * proc) {
+	int i;
+	for (i = 0; i < nprocs; i++) {
+		if (procs[i] == proc) return i;
+	}
+	return -1;
+}
+
+static void add_proc_ref(struct pcb_t *** procs, int * nprocs,
+			 struct pcb_t * proc) {
+	if (proc == NULL || proc_index(*procs, *nprocs, proc) >= 0) {
+		return;
+	}
+	*procs = realloc(*procs, (*nprocs + 1) * sizeof(struct pcb_t *));
+	(*procs)[(*nprocs)++] = proc;
+}
+
+static struct pcb_t * get_proc_ref(struct ckpt_in * in, struct pcb_t ** procs,
+				   int nprocs) {
+	int32_t i;
+	GET(in, i);
+	if (i < -1 || i >= nprocs) {
+		in->err = 1;
+		return NULL;
+	}
+	return i < 0 ? NULL : procs[i];
+}
+
+static void save_queue(struct ckpt_out * o, struct queue_t * q,
+		       struct pcb_t ** procs, int nprocs) {
+	int i;
+	put_u32(o, q->size);
+	for (i = 0; i < q->size; i++) {
+		int32_t idx = proc_index(procs, nprocs, queue_at(q, i));
+		PUT(o, idx);
+	}
+}
+
+static void load_queue(struct ckpt_in * in, struct queue_t * q,
+		       struct pcb_t ** procs, int nprocs) {
+	uint32_t size = get_count(in, sizeof(int32_t));
+	uint32_t i;
+	for (i = 0; i < size; i++) {
+		struct pcb_t * proc = get_proc_ref(in, procs, nprocs);
+		if (proc != NULL) {
+			enqueue(q, proc);
+		}
+	}
+}
+
+static void save_heap(struct ckpt_out * o, struct proc_heap * h,
+		      struct pcb_t ** procs, int nprocs) {
+	int i;
+	put_u32(o, h->nr);
+	for (i = 0; i < h->nr; i++) {
+		int32_t idx = proc_index(procs, nprocs, h->ent[i].proc);
+		PUT(o, idx);
+		PUT(o, h->ent[i].key);
+		PUT(o, h->ent[i].seq);
+	}
+	PUT(o, h->seq);
+}
+
+static void load_heap(struct ckpt_in * in, struct proc_heap * h,
+		      struct pcb_t ** procs, int nprocs) {
+	uint32_t nr = get_count(in, sizeof(int32_t) + 2 * sizeof(uint64_t));
+	uint32_t i;
+	for (i = 0; i < nr; i++) {
+		struct pcb_t * proc = get_proc_ref(in, procs, nprocs);
+		uint64_t key, seq;
+		GET(in, key);
+		GET(in, seq);
+		if (proc != NULL) {
+			heap_insert(h, proc, key, seq);
+		}else{
+			in->err = 1;
+		}
+	}
+	GET(in, h->seq);
+}
+
+#ifdef MLQ_SCHED
+/* Whether [proc], on an MLQ ring, was not killed there */
+static int on_ring(struct pcb_t * proc) {
+	return atomic_load(&proc->queued) == RQ_QUEUED;
+}
+
+/* Processes killed on the ring are left out */
+static void save_ring(struct ckpt_out * o, struct ring_t * q,
+		      struct pcb_t ** procs, int nprocs) {
+	int size = ring_size(q);
+	int i;
+	uint32_t live = 0;
+	for (i = 0; i < size; i++) {
+		live += on_ring(ring_peek(q, i));
+	}
+	put_u32(o, live);
+	for (i = 0; i < size; i++) {
+		struct pcb_t * proc = ring_peek(q, i);
+		if (on_ring(proc)) {
+			int32_t idx = proc_index(procs, nprocs, proc);
+			PUT(o, idx);
+		}
+	}
+}
+
+static void load_ring(struct ckpt_in * in, struct ring_t * q,
+		      struct pcb_t ** procs, int nprocs) {
+	uint32_t size = get_count(in, sizeof(int32_t));
+	uint32_t i;
+	for (i = 0; i < size; i++) {
+		struct pcb_t * proc = get_proc_ref(in, procs, nprocs);
+		if (proc != NULL) {
+			ring_push(q, proc);
+		}
+	}
+}
+#endif
+
+/* Every process the scheduler or a CPU holds, in a fixed order */
+static int collect_procs(struct os_ctx * ctx, struct cpu_args * cpus,
+			 struct pcb_t *** procs) {
+	struct sched_state * sched = &ctx->sched;
+	int n = 0;
+	int i, j;
+	*procs = NULL;
+	for (i = 0; i < ctx->num_cpus; i++) {
+		add_proc_ref(procs, &n, cpus[i].proc);
+	}
+#ifdef MLQ_SCHED
+	int r;
+	for (r = 0; r < sched->nr_rq; r++) {
+		for (i = 0; i < MAX_PRIO; i++) {
+			struct ring_t * q = &sched->rq[r].mlq_ready_queue[i];
+			int size = ring_size(q);
+			for (j = 0; j < size; j++) {
+				if (on_ring(ring_peek(q, j))) {
+					add_proc_ref(procs, &n, ring_peek(q, j));
+				}
+			}
+		}
+	}
+#endif
+	struct rb_node * node;
+	for (node = sched->cfs_tree.first; node != NULL; node = rb_next(node)) {
+		add_proc_ref(procs, &n, rb_entry(node, struct pcb_t, cfs_node));
+	}
+	for (j = 0; j < sched->edf_heap.nr; j++) {
+		add_proc_ref(procs, &n, sched->edf_heap.ent[j].proc);
+	}
+	for (j = 0; j < sched->ready_queue.nr; j++) {
+		add_proc_ref(procs, &n, sched->ready_queue.ent[j].proc);
+	}
+	for (j = 0; j < sched->run_queue.nr; j++) {
+		add_proc_ref(procs, &n, sched->run_queue.ent[j].proc);
+	}
+	for (j = 0; j < sched->running_list.size; j++) {
+		add_proc_ref(procs, &n, queue_at(&sched->running_list, j));
+	}
+	return n;
+}
+
+static void save_config(struct ckpt_out * o, struct os_ctx * ctx) {
+	struct ld_args * ld = &ctx->ld_processes;
+	int i;
+	PUT(o, ctx->time_slot);
+	PUT(o, ctx->num_cpus);
+	PUT(o, ctx->num_processes);
+	PUT(o, ctx->percpu_rq);
+	uint32_t len = strlen(ctx->sched_ops->name);
+	PUT(o, len);
+	put(o, ctx->sched_ops->name, len);
+	PUT(o, ctx->warm_tol);
+	PUT(o, ctx->has_affinity);
+	PUT(o, ctx->preempt);
+	PUT(o, ctx->quantum);
+	PUT(o, ctx->adaptive_quantum);
+	PUT(o, ctx->mlfq_step);
+	PUT(o, ctx->mlfq_age);
+	PUT(o, ctx->mlfq_boost);
+#ifdef MM_PAGING
+	PUT(o, ctx->memramsz);
+	PUT(o, ctx->memswpsz);
+#endif
+	for (i = 0; i < ctx->num_processes; i++) {
+		len = strlen(ld->path[i]);
+		PUT(o, len);
+		put(o, ld->path[i], len);
+		PUT(o, ld->start_time[i]);
+#ifdef MLQ_SCHED
+		PUT(o, ld->prio[i]);
+#endif
+		PUT(o, ld->deadline[i]);
+		PUT(o, ld->affinity[i]);
+	}
+}
+
+static void load_config(struct ckpt_in * in, struct os_ctx * ctx) {
+	struct ld_args * ld = &ctx->ld_processes;
+	int i;
+	GET(in, ctx->time_slot);
+	GET(in, ctx->num_cpus);
+	GET(in, ctx->num_processes);
+	GET(in, ctx->percpu_rq);
+	char policy[16] = "";
+	uint32_t len = get_count(in, 1);
+	if (len >= sizeof(policy)) {
+		in->err = 1;
+		len = 0;
+	}
+	get(in, policy, len);
+	policy[len] = '\0';
+	if ((ctx->sched_ops = sched_find(policy)) == NULL) {
+		in->err = 1;
+		ctx->sched_ops = DEFAULT_SCHED_OPS;
+	}
+	GET(in, ctx->warm_tol);
+	GET(in, ctx->has_affinity);
+	GET(in, ctx->preempt);
+	GET(in, ctx->quantum);
+	GET(in, ctx->adaptive_quantum);
+	GET(in, ctx->mlfq_step);
+	GET(in, ctx->mlfq_age);
+	GET(in, ctx->mlfq_boost);
+#ifdef MM_PAGING
+	GET(in, ctx->memramsz);
+	GET(in, ctx->memswpsz);
+#endif
+	if (ctx->num_cpus < 0 || ctx->num_processes < 0 ||
+	    (size_t)ctx->num_processes > (size_t)(in->end - in->p)) {
+		in->err = 1;
+		ctx->num_processes = 0;
+	}
+	ld->path = (char **)malloc(sizeof(char *) * ctx->num_processes);
+	ld->start_time = (unsigned long *)malloc(sizeof(unsigned long) *
+						 ctx->num_processes);
+#ifdef MLQ_SCHED
+	ld->prio = (unsigned long *)malloc(sizeof(unsigned long) *
+					   ctx->num_processes);
+#endif
+	ld->deadline = (unsigned long *)malloc(sizeof(unsigned long) *
+					       ctx->num_processes);
+	ld->affinity = (uint64_t *)malloc(sizeof(uint64_t) *
+					  ctx->num_processes);
+	for (i = 0; i < ctx->num_processes; i++) {
+		len = get_count(in, 1);
+		ld->path[i] = (char *)malloc(len + 1);
+		get(in, ld->path[i], len);
+		ld->path[i][len] = '\0';
+		GET(in, ld->start_time[i]);
+#ifdef MLQ_SCHED
+		GET(in, ld->prio[i]);
+#endif
+		GET(in, ld->deadline[i]);
+		GET(in, ld->affinity[i]);
+	}
+}
+
+#ifdef MM_PAGING
+static void save_rg_list(struct ckpt_out * o, struct vm_rg_struct * rg) {
+	struct vm_rg_struct * it;
+	uint32_t n = 0;
+	for (it = rg; it != NULL; it = it->rg_next) n++;
+	PUT(o, n);
+	for (it = rg; it != NULL; it = it->rg_next) {
+		PUT(o, it->rg_start);
+		PUT(o, it->rg_end);
+	}
+}
+
+static struct vm_rg_struct * load_rg_list(struct ckpt_in * in) {
+	struct vm_rg_struct * head = NULL;
+	struct vm_rg_struct ** tail = &head;
+	uint32_t n = get_count(in, 2 * sizeof(unsigned long));
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		struct vm_rg_struct * rg = malloc(sizeof(struct vm_rg_struct));
+		GET(in, rg->rg_start);
+		GET(in, rg->rg_end);
+		rg->rg_next = NULL;
+		*tail = rg;
+		tail = &rg->rg_next;
+	}
+	return head;
+}
+
+static void save_mm(struct ckpt_out * o, struct mm_struct * mm) {
+	struct vm_area_struct * vma;
+	struct pgn_t * pg;
+	uint32_t n = 0;
+	uint32_t pgn;
+	int i;
+
+	/* Page tables are mostly empty, only the mapped entries */
+	for (pgn = 0; pgn < PAGING_MAX_PGN; pgn++) {
+		if (mm->pgd[pgn] != 0) n++;
+	}
+	PUT(o, n);
+	for (pgn = 0; pgn < PAGING_MAX_PGN; pgn++) {
+		if (mm->pgd[pgn] != 0) {
+			PUT(o, pgn);
+			PUT(o, mm->pgd[pgn]);
+		}
+	}
+	for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
+		PUT(o, mm->symrgtbl[i].rg_start);
+		PUT(o, mm->symrgtbl[i].rg_end);
+	}
+
+	n = 0;
+	for (vma = mm->mmap; vma != NULL; vma = vma->vm_next) n++;
+	PUT(o, n);
+	for (vma = mm->mmap; vma != NULL; vma = vma->vm_next) {
+		PUT(o, vma->vm_id);
+		PUT(o, vma->vm_start);
+		PUT(o, vma->vm_end);
+		PUT(o, vma->sbrk);
+		save_rg_list(o, vma->vm_freerg_list);
+	}
+
+	n = 0;
+	for (pg = mm->fifo_pgn; pg != NULL; pg = pg->pg_next) n++;
+	PUT(o, n);
+	for (pg = mm->fifo_pgn; pg != NULL; pg = pg->pg_next) {
+		PUT(o, pg->pgn);
+	}
+}
+
+static void load_mm(struct ckpt_in * in, struct mm_struct * mm) {
+	struct vm_area_struct ** vtail = &mm->mmap;
+	struct pgn_t ** ptail = &mm->fifo_pgn;
+	uint32_t n, i;
+	int j;
+
+	mm->pgd = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
+	n = get_count(in, 2 * sizeof(uint32_t));
+	for (i = 0; i < n; i++) {
+		uint32_t pgn = get_u32(in);
+		uint32_t pte = get_u32(in);
+		if (pgn >= PAGING_MAX_PGN) {
+			in->err = 1;
+			break;
+		}
+		mm->pgd[pgn] = pte;
+	}
+	for (j = 0; j < PAGING_MAX_SYMTBL_SZ; j++) {
+		GET(in, mm->symrgtbl[j].rg_start);
+		GET(in, mm->symrgtbl[j].rg_end);
+		mm->symrgtbl[j].rg_next = NULL;
+	}
+
+	mm->mmap = NULL;
+	n = get_count(in, 4 * sizeof(unsigned long));
+	for (i = 0; i < n; i++) {
+		struct vm_area_struct * vma =
+			malloc(sizeof(struct vm_area_struct));
+		GET(in, vma->vm_id);
+		GET(in, vma->vm_start);
+		GET(in, vma->vm_end);
+		GET(in, vma->sbrk);
+		vma->vm_freerg_list = load_rg_list(in);
+		vma->vm_mm = mm;
+		vma->vm_next = NULL;
+		*vtail = vma;
+		vtail = &vma->vm_next;
+	}
+
+	mm->fifo_pgn = NULL;
+	n = get_count(in, sizeof(int));
+	for (i = 0; i < n; i++) {
+		struct pgn_t * pg = malloc(sizeof(struct pgn_t));
+		GET(in, pg->pgn);
+		pg->pg_next = NULL;
+		*ptail = pg;
+		ptail = &pg->pg_next;
+	}
+}
+
+/* Free frame lists are saved as runs of consecutive frame numbers: a
+ * fresh device is a single run and allocations only cut a few holes */
+static void save_free_frames(struct ckpt_out * o, struct framephy_struct * fp) {
+	struct framephy_struct * it;
+	uint32_t nruns = 0;
+	int32_t run[2];		/* First frame, length */
+
+	for (it = fp; it != NULL; it = it->fp_next) {
+		if (it == fp || it->fpn != run[0] + run[1]) {
+			nruns++;
+			run[0] = it->fpn;
+			run[1] = 0;
+		}
+		run[1]++;
+	}
+	PUT(o, nruns);
+	for (it = fp; it != NULL; it = it->fp_next) {
+		if (it != fp && it->fpn != run[0] + run[1]) {
+			PUT(o, run);
+		}
+		if (it == fp || it->fpn != run[0] + run[1]) {
+			run[0] = it->fpn;
+			run[1] = 0;
+		}
+		run[1]++;
+	}
+	if (nruns > 0) {
+		PUT(o, run);
+	}
+}
+
+static struct framephy_struct * load_free_frames(struct ckpt_in * in,
+						 int maxfpn) {
+	struct framephy_struct * head = NULL;
+	struct framephy_struct ** tail = &head;
+	uint32_t nruns = get_count(in, 2 * sizeof(int32_t));
+	uint32_t r;
+	for (r = 0; r < nruns && !in->err; r++) {
+		int32_t start, len, fpn;
+		GET(in, start);
+		GET(in, len);
+		if (start < 0 || len < 0 || start + (int64_t)len > maxfpn) {
+			in->err = 1;
+			break;
+		}
+		for (fpn = start; fpn < start + len; fpn++) {
+			struct framephy_struct * fp =
+				malloc(sizeof(struct framephy_struct));
+			fp->fpn = fpn;
+			fp->fp_next = NULL;
+			fp->owner = NULL;
+			*tail = fp;
+			tail = &fp->fp_next;
+		}
+	}
+	return head;
+}
+
+static void save_memphy(struct ckpt_out * o, struct memphy_struct * mp,
+			struct pcb_t ** procs, int nprocs) {
+	struct framephy_struct * fp;
+	uint32_t n = 0;
+	PUT(o, mp->maxsz);
+	PUT(o, mp->rdmflg);
+	PUT(o, mp->cursor);
+	save_free_frames(o, mp->free_fp_list);
+
+	for (fp = mp->used_fp_list; fp != NULL; fp = fp->fp_next) n++;
+	PUT(o, n);
+	for (fp = mp->used_fp_list; fp != NULL; fp = fp->fp_next) {
+		int32_t owner = -1;
+		int i;
+		for (i = 0; i < nprocs; i++) {
+			if (fp->owner != NULL && procs[i]->mm == fp->owner) {
+				owner = i;
+			}
+		}
+		PUT(o, fp->fpn);
+		PUT(o, owner);
+	}
+}
+
+static void load_memphy(struct ckpt_in * in, struct ckpt * ck, int dev,
+			struct memphy_struct * mp, struct pcb_t ** procs,
+			int nprocs) {
+	struct framephy_struct ** tail = &mp->used_fp_list;
+	uint64_t off = ck->hdr->storage_off[dev];
+	uint32_t n, i;
+
+	GET(in, mp->maxsz);
+	GET(in, mp->rdmflg);
+	GET(in, mp->cursor);
+	mp->storage = NULL;
+	mp->mapped = 0;
+	if (mp->maxsz < 0 || off > ck->size ||
+	    (size_t)mp->maxsz > ck->size - off) {
+		in->err = 1;
+		mp->maxsz = 0;
+	}else if (mp->maxsz > 0) {
+		mp->storage = mmap(NULL, mp->maxsz, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE, ck->fd, off);
+		if (mp->storage == MAP_FAILED) {
+			in->err = 1;
+			mp->storage = NULL;
+			mp->maxsz = 0;
+		}else{
+			mp->mapped = 1;
+		}
+	}
+	mp->free_fp_list = load_free_frames(in, mp->maxsz / PAGING_PAGESZ);
+
+	mp->used_fp_list = NULL;
+	n = get_count(in, 2 * sizeof(int32_t));
+	for (i = 0; i < n; i++) {
+		struct framephy_struct * fp =
+			malloc(sizeof(struct framephy_struct));
+		struct pcb_t * owner;
+		GET(in, fp->fpn);
+		owner = get_proc_ref(in, procs, nprocs);
+		fp->owner = owner != NULL ? owner->mm : NULL;
+		fp->fp_next = NULL;
+		*tail = fp;
+		tail = &fp->fp_next;
+	}
+}
+
+/* Image of [mp] at [off], leaving a hole for every page that is still
+ * blank (most of a swap device usually is) */
+static int write_storage(int fd, struct memphy_struct * mp, uint64_t off,
+			 long pagesz) {
+	long pos, n;
+	for (pos = 0; pos < mp->maxsz; pos += pagesz) {
+		const char * p = mp->storage + pos;
+		n = mp->maxsz - pos < pagesz ? mp->maxsz - pos : pagesz;
+		if (p[0] == 0 && memcmp(p, p + 1, n - 1) == 0) continue;
+		if (pwrite(fd, p, n, off + pos) != n) return -1;
+	}
+	return 0;
+}
+#endif
+
+static void save_proc(struct ckpt_out * o, struct pcb_t * proc,
+		      struct loader_args * ld) {
+	PUT(o, proc->pid);
+	PUT(o, proc->priority);
+	PUT(o, proc->path);
+	PUT(o, proc->regs);
+	PUT(o, proc->pc);
+	PUT(o, proc->bp);
+	PUT(o, proc->code->size);
+	put(o, proc->code->text, proc->code->size * sizeof(struct inst_t));
+#ifdef MLQ_SCHED
+	PUT(o, proc->prio);
+	PUT(o, proc->base_prio);
+	PUT(o, proc->boosts);
+	PUT(o, proc->level_since);
+#endif
+	PUT(o, proc->vruntime);
+	PUT(o, proc->deadline);
+	PUT(o, proc->affinity);
+	PUT(o, proc->last_cpu);
+	PUT(o, proc->migrations);
+	PUT(o, proc->arrival);
+	PUT(o, proc->first_run);
+	PUT(o, proc->ready_since);
+	PUT(o, proc->wait);
+	PUT(o, proc->switches);
+#ifdef MM_PAGING
+	int32_t swp = proc->active_mswp - (struct memphy_struct *)ld->mswp;
+	PUT(o, swp);
+	PUT(o, proc->active_mswp_id);
+	save_mm(o, proc->mm);
+#endif
+}
+
+static struct pcb_t * load_proc(struct ckpt_in * in, struct os_ctx * ctx,
+				struct loader_args * ld) {
+	struct pcb_t * proc = (struct pcb_t *)malloc(sizeof(struct pcb_t));
+	GET(in, proc->pid);
+	GET(in, proc->priority);
+	GET(in, proc->path);
+	proc->path[sizeof(proc->path) - 1] = '\0';
+	GET(in, proc->regs);
+	GET(in, proc->pc);
+	GET(in, proc->bp);
+	proc->code = (struct code_seg_t *)malloc(sizeof(struct code_seg_t));
+	proc->code->size = get_count(in, sizeof(struct inst_t));
+	proc->code->text = (struct inst_t *)malloc(
+		sizeof(struct inst_t) * proc->code->size);
+	get(in, proc->code->text, proc->code->size * sizeof(struct inst_t));
+	proc->page_table =
+		(struct page_table_t *)malloc(sizeof(struct page_table_t));
+	proc->ready_queue = &ctx->sched.ready_queue;
+	proc->running_list = &ctx->sched.running_list;
+	proc->heap_idx = -1;
+	proc->live = NULL;
+	rb_clear(&proc->cfs_node);
+#ifdef MLQ_SCHED
+	proc->rq = 0;
+	atomic_init(&proc->queued, RQ_NONE);	/* Until sched_sync_rq() */
+	GET(in, proc->prio);
+	GET(in, proc->base_prio);
+	GET(in, proc->boosts);
+	GET(in, proc->level_since);
+	if (proc->prio >= MAX_PRIO || proc->base_prio >= MAX_PRIO) {
+		in->err = 1;
+		proc->prio = proc->base_prio = 0;
+	}
+#endif
+	GET(in, proc->vruntime);
+	GET(in, proc->deadline);
+	GET(in, proc->affinity);
+	GET(in, proc->last_cpu);
+	GET(in, proc->migrations);
+	GET(in, proc->arrival);
+	GET(in, proc->first_run);
+	GET(in, proc->ready_since);
+	GET(in, proc->wait);
+	GET(in, proc->switches);
+#ifdef MM_PAGING
+	int32_t swp;
+	GET(in, swp);
+	if (swp < 0 || swp >= PAGING_MAX_MMSWP) {
+		in->err = 1;
+		swp = 0;
+	}
+	GET(in, proc->active_mswp_id);
+	proc->mram = ld->mram;
+	proc->mswp = ld->mswp;
+	proc->active_mswp = &((struct memphy_struct *)ld->mswp)[swp];
+	proc->mm = malloc(sizeof(struct mm_struct));
+	load_mm(in, proc->mm);
+#endif
+	return proc;
+}
+
+int ckpt_save(struct os_ctx * ctx, const char * path, struct cpu_args * cpus,
+	      struct loader_args * ld) {
+	struct sched_state * sched = &ctx->sched;
+	struct timer_state * t = &ctx->timer;
+	struct ckpt_header hdr;
+	struct ckpt_out o = {0};
+	struct pcb_t ** procs;
+	int nprocs = collect_procs(ctx, cpus, &procs);
+	unsigned long stats[] = {
+		atomic_load(&ctx->stats.busy_slots),
+		atomic_load(&ctx->stats.idle_slots),
+		atomic_load(&ctx->stats.idle_ready),
+		atomic_load(&ctx->stats.dispatches),
+		atomic_load(&ctx->stats.finished),
+		atomic_load(&ctx->stats.alloc_fails),
+		atomic_load(&ctx->stats.page_faults),
+		atomic_load(&ctx->stats.migrations),
+		atomic_load(&ctx->stats.preemptions),
+	};
+	int ahead[TIMER_AHEAD_SLOTS];
+	int done = atomic_load(&ctx->done);
+	unsigned int gen = atomic_load(&t->gen);
+	int i, r;
+
+	save_config(&o, ctx);
+
+	PUT(&o, ctx->ld_next);
+	PUT(&o, done);
+	PUT(&o, ctx->avail_pid);
+	PUT(&o, stats);
+	unsigned long lateness[LATENESS_BUCKETS + 2];
+	for (i = 0; i < LATENESS_BUCKETS; i++) {
+		lateness[i] = atomic_load(&ctx->stats.lateness[i]);
+	}
+	lateness[i++] = atomic_load(&ctx->stats.total_lateness);
+	lateness[i] = atomic_load(&ctx->stats.max_lateness);
+	PUT(&o, lateness);
+	for (i = 0; i <= ctx->num_processes; i++) {
+		PUT(&o, ctx->procstat[i]);
+	}
+	for (i = 0; i < ctx->num_cpus; i++) {
+		uint64_t rank = atomic_load(&ctx->cpus[i].rank);
+		int preempt = atomic_load(&ctx->cpus[i].preempt);
+		PUT(&o, rank);
+		PUT(&o, preempt);
+	}
+	PUT(&o, t->time);
+	PUT(&o, gen);
+	for (i = 0; i < TIMER_AHEAD_SLOTS; i++) {
+		ahead[i] = atomic_load(&t->ahead[i]);
+	}
+	PUT(&o, ahead);
+
+	put_u32(&o, nprocs);
+	for (i = 0; i < nprocs; i++) {
+		save_proc(&o, procs[i], ld);
+	}
+
+	for (i = 0; i < ctx->num_cpus; i++) {
+		int32_t running = cpus[i].timer_id != NULL;
+		int32_t proc = proc_index(procs, nprocs, cpus[i].proc);
+		PUT(&o, running);
+		PUT(&o, proc);
+		PUT(&o, cpus[i].time_left);
+		PUT(&o, cpus[i].resume);
+	}
+
+#ifdef MLQ_SCHED
+	PUT(&o, sched->slot);
+	PUT(&o, sched->next_rq);
+	for (r = 0; r < sched->nr_rq; r++) {
+		struct mlq_rq * rq = &sched->rq[r];
+		int slot_usage[MAX_PRIO];
+		for (i = 0; i < MAX_PRIO; i++) {
+			save_ring(&o, &rq->mlq_ready_queue[i], procs, nprocs);
+			slot_usage[i] = atomic_load(&rq->slot_usage[i]);
+		}
+		PUT(&o, slot_usage);
+		PUT(&o, rq->picks);
+		PUT(&o, rq->seed);
+	}
+	uint64_t mlfq[4] = {
+		atomic_load(&sched->mlfq_next_pass),
+		atomic_load(&sched->mlfq_boosts),
+		atomic_load(&sched->mlfq_demotions),
+		atomic_load(&sched->mlfq_promotions),
+	};
+	unsigned long residency[MAX_PRIO];
+	for (i = 0; i < MAX_PRIO; i++) {
+		residency[i] = atomic_load(&sched->residency[i]);
+	}
+	PUT(&o, mlfq);
+	PUT(&o, sched->mlfq_next_boost);
+	PUT(&o, residency);
+#endif
+	/* The CFS tree in order, which a restore inserts back as it is */
+	struct rb_node * node;
+	uint32_t ncfs = 0;
+	for (node = sched->cfs_tree.first; node != NULL; node = rb_next(node)) {
+		ncfs++;
+	}
+	PUT(&o, sched->min_vruntime);
+	PUT(&o, sched->quantum);
+	PUT(&o, sched->qwin);
+	PUT(&o, ncfs);
+	for (node = sched->cfs_tree.first; node != NULL; node = rb_next(node)) {
+		int32_t idx = proc_index(procs, nprocs,
+					 rb_entry(node, struct pcb_t, cfs_node));
+		PUT(&o, idx);
+	}
+	save_heap(&o, &sched->edf_heap, procs, nprocs);
+	save_heap(&o, &sched->ready_queue, procs, nprocs);
+	save_heap(&o, &sched->run_queue, procs, nprocs);
+	save_queue(&o, &sched->running_list, procs, nprocs);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CKPT_MAGIC, sizeof(hdr.magic));
+	hdr.hdr_size = sizeof(hdr);
+	hdr.max_prio = MAX_PRIO;
+	hdr.max_pgn = PAGING_MAX_PGN;
+	hdr.symtbl_sz = PAGING_MAX_SYMTBL_SZ;
+	hdr.ahead_slots = TIMER_AHEAD_SLOTS;
+
+	/* The memory devices go last: their images are laid out right
+	 * after the metadata, which has to know where they start */
+	struct memphy_struct * dev[CKPT_NDEV] = {0};
+#ifdef MM_PAGING
+	dev[0] = ld->mram;
+	for (i = 0; i < PAGING_MAX_MMSWP; i++) {
+		dev[1 + i] = &((struct memphy_struct *)ld->mswp)[i];
+	}
+	for (i = 0; i < CKPT_NDEV; i++) {
+		save_memphy(&o, dev[i], procs, nprocs);
+	}
+#endif
+	long pagesz = sysconf(_SC_PAGESIZE);
+	uint64_t off = sizeof(hdr) + o.len;
+	hdr.meta_off = sizeof(hdr);
+	hdr.meta_size = o.len;
+	for (i = 0; i < CKPT_NDEV; i++) {
+		off = (off + pagesz - 1) / pagesz * pagesz;
+		hdr.storage_off[i] = off;
+		if (dev[i] != NULL && dev[i]->maxsz > 0) {
+			off += dev[i]->maxsz;
+		}
+	}
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	int ret = 0;
+	if (fd < 0) {
+		fprintf(stderr, "Cannot create checkpoint %s\n", path);
+		ret = -1;
+	}else{
+		if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+		    pwrite(fd, o.buf, o.len, hdr.meta_off) != (ssize_t)o.len) {
+			ret = -1;
+		}
+#ifdef MM_PAGING
+		for (i = 0; i < CKPT_NDEV && ret == 0; i++) {
+			ret = write_storage(fd, dev[i], hdr.storage_off[i],
+					    pagesz);
+		}
+#endif
+		/* Also the end of the last image, and pads it to a page */
+		if (ret == 0 && ftruncate(fd, (off + pagesz - 1) /
+						pagesz * pagesz) != 0) {
+			ret = -1;
+		}
+		if (close(fd) != 0 || ret != 0) {
+			fprintf(stderr, "Cannot write checkpoint %s\n", path);
+			ret = -1;
+		}
+	}
+	free(o.buf);
+	free(procs);
+	return ret;
+}
+
+int ckpt_open(struct os_ctx * ctx, const char * path) {
+	struct ckpt * ck = calloc(1, sizeof(struct ckpt));
+	struct stat st;
+
+	if ((ck->fd = open(path, O_RDONLY)) < 0) {
+		printf("Cannot open checkpoint %s\n", path);
+		free(ck);
+		return -1;
+	}
+	fstat(ck->fd, &st);
+	ck->size = st.st_size;
+	ck->map = ck->size < sizeof(struct ckpt_header) ? MAP_FAILED :
+		mmap(NULL, ck->size, PROT_READ, MAP_PRIVATE, ck->fd, 0);
+	const struct ckpt_header * hdr = (const struct ckpt_header *)ck->map;
+	if (ck->map == MAP_FAILED ||
+	    memcmp(hdr->magic, CKPT_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->hdr_size != sizeof(struct ckpt_header) ||
+	    hdr->max_prio != MAX_PRIO ||
+	    hdr->max_pgn != PAGING_MAX_PGN ||
+	    hdr->symtbl_sz != PAGING_MAX_SYMTBL_SZ ||
+	    hdr->ahead_slots != TIMER_AHEAD_SLOTS ||
+	    hdr->meta_off > ck->size ||
+	    hdr->meta_size > ck->size - hdr->meta_off) {
+		printf("%s is not a checkpoint of this build\n", path);
+		if (ck->map != MAP_FAILED) munmap(ck->map, ck->size);
+		close(ck->fd);
+		free(ck);
+		return -1;
+	}
+	ck->hdr = hdr;
+	ck->in.p = ck->map + hdr->meta_off;
+	ck->in.end = ck->in.p + hdr->meta_size;
+	load_config(&ck->in, ctx);
+	ctx->restore = ck;
+	if (ck->in.err) {
+		printf("Checkpoint %s is damaged\n", path);
+		ckpt_close(ctx);
+		return -1;
+	}
+	return 0;
+}
+
+int ckpt_load(struct os_ctx * ctx, struct cpu_args * cpus,
+	      struct loader_args * ld) {
+	struct ckpt * ck = ctx->restore;
+	struct ckpt_in * in = &ck->in;
+	struct sched_state * sched = &ctx->sched;
+	struct timer_state * t = &ctx->timer;
+	struct pcb_t ** procs;
+	unsigned long stats[9];
+	int ahead[TIMER_AHEAD_SLOTS];
+	int done;
+	unsigned int gen;
+	int nprocs;
+	int i, r;
+
+	GET(in, ctx->ld_next);
+	GET(in, done);
+	atomic_store(&ctx->done, done);
+	GET(in, ctx->avail_pid);
+	GET(in, stats);
+	atomic_store(&ctx->stats.busy_slots, stats[0]);
+	atomic_store(&ctx->stats.idle_slots, stats[1]);
+	atomic_store(&ctx->stats.idle_ready, stats[2]);
+	atomic_store(&ctx->stats.dispatches, stats[3]);
+	atomic_store(&ctx->stats.finished, stats[4]);
+	atomic_store(&ctx->stats.alloc_fails, stats[5]);
+	atomic_store(&ctx->stats.page_faults, stats[6]);
+	atomic_store(&ctx->stats.migrations, stats[7]);
+	atomic_store(&ctx->stats.preemptions, stats[8]);
+	unsigned long lateness[LATENESS_BUCKETS + 2];
+	GET(in, lateness);
+	for (i = 0; i < LATENESS_BUCKETS; i++) {
+		atomic_store(&ctx->stats.lateness[i], lateness[i]);
+	}
+	atomic_store(&ctx->stats.total_lateness, lateness[i++]);
+	atomic_store(&ctx->stats.max_lateness, lateness[i]);
+	for (i = 0; i <= ctx->num_processes; i++) {
+		GET(in, ctx->procstat[i]);
+	}
+	for (i = 0; i < ctx->num_cpus; i++) {
+		uint64_t rank;
+		int preempt;
+		GET(in, rank);
+		GET(in, preempt);
+		atomic_store(&ctx->cpus[i].rank, rank);
+		atomic_store(&ctx->cpus[i].preempt, preempt);
+	}
+	GET(in, t->time);
+	GET(in, gen);
+	atomic_store(&t->gen, gen);
+	GET(in, ahead);
+	for (i = 0; i < TIMER_AHEAD_SLOTS; i++) {
+		atomic_store(&t->ahead[i], ahead[i]);
+	}
+
+	nprocs = get_count(in, sizeof(uint32_t));
+	procs = malloc(nprocs * sizeof(struct pcb_t *));
+	for (i = 0; i < nprocs; i++) {
+		procs[i] = load_proc(in, ctx, ld);
+		if (procs[i]->pid == 0 ||
+		    procs[i]->pid > (uint32_t)ctx->num_processes) {
+			in->err = 1;
+		}else{
+			sched_add_live(procs[i]);
+		}
+	}
+
+	for (i = 0; i < ctx->num_cpus; i++) {
+		int32_t running;
+		GET(in, running);
+		cpus[i].proc = get_proc_ref(in, procs, nprocs);
+		GET(in, cpus[i].time_left);
+		GET(in, cpus[i].resume);
+		cpus[i].timer_id = running ? attach_event() : NULL;
+	}
+	ld->timer_id = done ? NULL : attach_event();
+
+#ifdef MLQ_SCHED
+	GET(in, sched->slot);
+	GET(in, sched->next_rq);
+	if (sched->next_rq < 0 ||
+	    (sched->nr_rq > 0 && sched->next_rq >= sched->nr_rq)) {
+		in->err = 1;
+		sched->next_rq = 0;
+	}
+	for (r = 0; r < sched->nr_rq; r++) {
+		struct mlq_rq * rq = &sched->rq[r];
+		int slot_usage[MAX_PRIO];
+		for (i = 0; i < MAX_PRIO; i++) {
+			load_ring(in, &rq->mlq_ready_queue[i], procs, nprocs);
+		}
+		GET(in, slot_usage);
+		for (i = 0; i < MAX_PRIO; i++) {
+			atomic_store(&rq->slot_usage[i], slot_usage[i]);
+		}
+		GET(in, rq->picks);
+		GET(in, rq->seed);
+		sched_sync_rq(rq);
+	}
+	uint64_t mlfq[4];
+	unsigned long residency[MAX_PRIO];
+	GET(in, mlfq);
+	GET(in, sched->mlfq_next_boost);
+	GET(in, residency);
+	atomic_store(&sched->mlfq_next_pass, mlfq[0]);
+	atomic_store(&sched->mlfq_boosts, mlfq[1]);
+	atomic_store(&sched->mlfq_demotions, mlfq[2]);
+	atomic_store(&sched->mlfq_promotions, mlfq[3]);
+	for (i = 0; i < MAX_PRIO; i++) {
+		atomic_store(&sched->residency[i], residency[i]);
+	}
+#endif
+	GET(in, sched->min_vruntime);
+	GET(in, sched->quantum);
+	GET(in, sched->qwin);
+	for (i = 0; i < MAX_PRIO; i++) {
+		if (sched->quantum[i] <= 0) {
+			in->err = 1;
+			sched->quantum[i] = 1;
+		}
+	}
+	uint32_t ncfs = get_count(in, sizeof(int32_t));
+	for (i = 0; i < (int)ncfs; i++) {
+		struct pcb_t * proc = get_proc_ref(in, procs, nprocs);
+		if (proc != NULL) {
+			cfs_insert(proc);
+		}
+	}
+	load_heap(in, &sched->edf_heap, procs, nprocs);
+	load_heap(in, &sched->ready_queue, procs, nprocs);
+	load_heap(in, &sched->run_queue, procs, nprocs);
+	load_queue(in, &sched->running_list, procs, nprocs);
+
+#ifdef MM_PAGING
+	load_memphy(in, ck, 0, ld->mram, procs, nprocs);
+	for (i = 0; i < PAGING_MAX_MMSWP; i++) {
+		load_memphy(in, ck, 1 + i,
+			    &((struct memphy_struct *)ld->mswp)[i],
+			    procs, nprocs);
+	}
+#endif
+	free(procs);
+
+	int ret = in->err ? -1 : 0;
+	if (ret != 0) {
+		printf("Checkpoint is damaged\n");
+	}
+	ckpt_close(ctx);
+	return ret;
+}
+
+void ckpt_close(struct os_ctx * ctx) {
+	struct ckpt * ck = ctx->restore;
+	if (ck == NULL) {
+		return;
+	}
+	munmap(ck->map, ck->size);
+	close(ck->fd);
+	free(ck);
+	ctx->restore = NULL;
+}
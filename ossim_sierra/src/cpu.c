@@ -4,6 +4,7 @@
 #include "mm.h"    
 #include "syscall.h"
 #include "libmem.h"
+#include "os-ctx.h"
 
 
 int calc(struct pcb_t *proc);
@@ -62,6 +63,7 @@ int run(struct pcb_t *proc)
     }
 
     struct inst_t ins = proc->code->text[proc->pc]; 
+    trace(insn, proc->pid, proc->pc, ins.opcode);
     proc->pc++; 
     int stat = 1; 
 
@@ -73,7 +75,7 @@ int run(struct pcb_t *proc)
             break;
 
         case ALLOC:
-            printf("===== PHYSICAL MEMORY AFTER ALLOCATION =====\n");
+            os_event(EV_ALLOC_HDR, 0, 0, 0, 0);
         
             stat = liballoc(proc, ins.arg_0, ins.arg_1);
             if (stat == 0) {
@@ -83,25 +85,24 @@ int run(struct pcb_t *proc)
                 } else {
                     fprintf(stderr, "Warning: Could not retrieve valid address for allocated region %d PID %d after alloc\n", ins.arg_1, proc->pid);
                 }
-                printf("PID=%d - Region=%d - Address=%08lx - Size=%d byte\n",
-                       proc->pid, ins.arg_1, (unsigned long)allocated_addr, ins.arg_0);
+                os_event(EV_ALLOC, proc->pid, ins.arg_1, allocated_addr, ins.arg_0);
                 #ifdef PAGETBL_DUMP
                 print_pgtbl(proc, 0, -1); 
                 #else
               
-                printf("================================================================\n");
+                os_event(EV_SEPARATOR, 0, 0, 0, 0);
                 #endif
             } else {
-               
-                 printf("ALLOCATION FAILED for PID=%d Region=%d Size=%d\n", proc->pid, ins.arg_1, ins.arg_0);
-                 printf("================================================================\n");
+                 atomic_fetch_add(&cur_ctx->stats.alloc_fails, 1);
+                 os_event(EV_ALLOC_FAIL, proc->pid, ins.arg_1, ins.arg_0, 0);
+                 os_event(EV_SEPARATOR, 0, 0, 0, 0);
             }
             break; 
 
         case FREE:
-            printf("===== PHYSICAL MEMORY AFTER DEALLOCATION =====\n");
+            os_event(EV_FREE_HDR, 0, 0, 0, 0);
 
-            printf("PID=%d - Region=%d\n", proc->pid, ins.arg_0);
+            os_event(EV_FREE, proc->pid, ins.arg_0, 0, 0);
 
             stat = libfree(proc, ins.arg_0);
 
@@ -109,20 +110,20 @@ int run(struct pcb_t *proc)
             print_pgtbl(proc, 0, -1);
             #else
 
-            printf("================================================================\n");
+            os_event(EV_SEPARATOR, 0, 0, 0, 0);
             #endif
             break; 
 
         case READ:
 
-            printf("===== PHYSICAL MEMORY AFTER READING =====\n");
+            os_event(EV_READ_HDR, 0, 0, 0, 0);
 
             stat = libread(proc, ins.arg_0, ins.arg_1, &ins.arg_2);
 
             break; 
 
         case WRITE:
-            printf("===== PHYSICAL MEMORY AFTER WRITING =====\n");
+            os_event(EV_WRITE_HDR, 0, 0, 0, 0);
             stat = libwrite(proc, (BYTE)ins.arg_0, ins.arg_1, ins.arg_2); 
             break; 
 
@@ -0,0 +1,120 @@
+/* evdecode - render a binary event log written by `os -b` back into the
+ * simulator's text output */
+
+#include "evlog.h"
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static FILE * in;
+
+static int get_varint(uint64_t * v) {
+	int shift = 0;
+	int c;
+	*v = 0;
+	do {
+		if ((c = getc_unlocked(in)) == EOF) {
+			return -1;
+		}
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 0;
+}
+
+/* Page tables of the processes, as of the last PTE delta */
+static uint32_t ** pgtbl;
+static uint32_t npgtbl;
+
+static uint32_t * get_pgtbl(uint32_t pid) {
+	if (pid >= npgtbl) {
+		uint32_t n = npgtbl ? npgtbl : 16;
+		while (n <= pid) n *= 2;
+		pgtbl = realloc(pgtbl, n * sizeof(uint32_t *));
+		memset(pgtbl + npgtbl, 0, (n - npgtbl) * sizeof(uint32_t *));
+		npgtbl = n;
+	}
+	if (pgtbl[pid] == NULL) {
+		pgtbl[pid] = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
+	}
+	return pgtbl[pid];
+}
+
+int main(int argc, char * argv[]) {
+	char magic[sizeof(EVLOG_MAGIC)] = {0};
+	char * ram = NULL;
+	int ramsz = 0;
+	char * str = NULL;
+	size_t strsz = 0;
+	int ev;
+
+	if (argc != 2) {
+		printf("Usage: evdecode [event log written by os -b]\n");
+		return 1;
+	}
+	if ((in = fopen(argv[1], "rb")) == NULL) {
+		printf("Cannot open event log %s\n", argv[1]);
+		return 1;
+	}
+	if (fread(magic, 1, strlen(EVLOG_MAGIC), in) != strlen(EVLOG_MAGIC) ||
+	    strcmp(magic, EVLOG_MAGIC) != 0) {
+		printf("%s is not an event log\n", argv[1]);
+		return 1;
+	}
+
+	while ((ev = getc_unlocked(in)) != EOF) {
+		long args[EV_MAX_ARGS] = {0};
+		int i;
+		if (ev >= EV_NR) {
+			fprintf(stderr, "evdecode: bad event type %d\n", ev);
+			return 1;
+		}
+		for (i = 0; i < ev_nargs[ev]; i++) {
+			uint64_t v;
+			if (get_varint(&v) != 0) goto truncated;
+			args[i] = (long)((v >> 1) ^ -(v & 1));
+		}
+		if (ev_has_str[ev]) {
+			uint64_t n;
+			if (get_varint(&n) != 0) goto truncated;
+			if (n + 1 > strsz) {
+				strsz = n + 1;
+				str = realloc(str, strsz);
+			}
+			if (fread(str, 1, n, in) != n) goto truncated;
+			str[n] = '\0';
+		}
+
+		switch (ev) {
+		case EV_RAM:
+			ramsz = args[0];
+			ram = realloc(ram, ramsz);
+			memset(ram, 0, ramsz);
+			break;
+		case EV_MEM:
+			if (args[0] >= 0 && args[0] < ramsz) {
+				ram[args[0]] = (char)args[1];
+			}
+			break;
+		case EV_PTE:
+			get_pgtbl(args[0])[args[1]] = args[2];
+			break;
+		case EV_PGTBL:
+			render_pgtbl(stdout, args[1], args[2],
+				     get_pgtbl(args[0]));
+			break;
+		case EV_MEMDUMP:
+			render_memdump(stdout, ram, ramsz);
+			break;
+		default:
+			render_event(stdout, ev, args, str);
+		}
+	}
+	fclose(in);
+	return 0;
+
+truncated:
+	fprintf(stderr, "evdecode: truncated event log\n");
+	return 1;
+}
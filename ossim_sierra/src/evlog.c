@@ -0,0 +1,170 @@
+#include "evlog.h"
+#include "mm.h"
+#include "os-ctx.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct evlog {
+	FILE * out;
+	pthread_mutex_t lock;		/* Keeps records and deltas whole */
+	struct memphy_struct * ram;	/* Device rebuilt by the decoder */
+	uint32_t ** shadow;		/* Page table of each pid as of its
+					 * last dump, indexed by pid */
+	uint32_t nshadow;
+};
+
+static int put_varint(unsigned char * buf, uint64_t v) {
+	int len = 0;
+	while (v >= 0x80) {
+		buf[len++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	buf[len++] = v;
+	return len;
+}
+
+static void put_locked(struct evlog * log, int ev, const long * args,
+		       const char * str) {
+	unsigned char buf[1 + (EV_MAX_ARGS + 1) * 10];
+	int len = 0;
+	int i;
+	buf[len++] = ev;
+	for (i = 0; i < ev_nargs[ev]; i++) {
+		int64_t v = args[i];
+		len += put_varint(buf + len, ((uint64_t)v << 1) ^ (v >> 63));
+	}
+	if (ev_has_str[ev]) {
+		size_t n = strlen(str);
+		len += put_varint(buf + len, n);
+		fwrite(buf, 1, len, log->out);
+		fwrite(str, 1, n, log->out);
+	}else{
+		fwrite(buf, 1, len, log->out);
+	}
+}
+
+static void put(struct evlog * log, int ev, const long * args,
+		const char * str) {
+	pthread_mutex_lock(&log->lock);
+	put_locked(log, ev, args, str);
+	pthread_mutex_unlock(&log->lock);
+}
+
+void os_event(int ev, long a0, long a1, long a2, long a3) {
+	long args[EV_MAX_ARGS] = {a0, a1, a2, a3};
+	if (cur_ctx->out != NULL) {
+		render_event(cur_ctx->out, ev, args, NULL);
+	}else if (cur_ctx->evlog != NULL) {
+		put(cur_ctx->evlog, ev, args, NULL);
+	}
+}
+
+void os_event_str(int ev, const char * str, long a0, long a1) {
+	long args[EV_MAX_ARGS] = {a0, a1, 0, 0};
+	if (cur_ctx->out != NULL) {
+		render_event(cur_ctx->out, ev, args, str);
+	}else if (cur_ctx->evlog != NULL) {
+		put(cur_ctx->evlog, ev, args, str);
+	}
+}
+
+void evlog_text(struct evlog * log, const char * fmt, ...) {
+	char buf[512];
+	char * str = buf;
+	long args[EV_MAX_ARGS] = {0};
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (n >= (int)sizeof(buf)) {
+		str = malloc(n + 1);
+		va_start(ap, fmt);
+		vsnprintf(str, n + 1, fmt, ap);
+		va_end(ap);
+	}
+	put(log, EV_TEXT, args, str);
+	if (str != buf) {
+		free(str);
+	}
+}
+
+void evlog_set_ram(struct evlog * log, struct memphy_struct * ram) {
+	long args[EV_MAX_ARGS] = {ram->maxsz};
+	int addr;
+	log->ram = ram;
+	put(log, EV_RAM, args, NULL);
+	/* A RAM restored from a checkpoint does not start out blank */
+	for (addr = 0; addr < ram->maxsz; addr++) {
+		if (ram->storage[addr] != 0) {
+			evlog_mem(log, ram, addr, ram->storage[addr]);
+		}
+	}
+}
+
+void evlog_mem(struct evlog * log, struct memphy_struct * mp, int addr,
+	       char value) {
+	if (mp != log->ram) {
+		return;
+	}
+	long args[EV_MAX_ARGS] = {addr, value};
+	put(log, EV_MEM, args, NULL);
+}
+
+void evlog_pgtbl(struct evlog * log, uint32_t pid, const uint32_t * pgd,
+		 uint32_t start, uint32_t end) {
+	int pgn_end = PAGING_PGN(end);
+	int pgit;
+
+	pthread_mutex_lock(&log->lock);
+	if (pid >= log->nshadow) {
+		uint32_t n = log->nshadow ? log->nshadow : 16;
+		while (n <= pid) n *= 2;
+		log->shadow = realloc(log->shadow, n * sizeof(uint32_t *));
+		memset(log->shadow + log->nshadow, 0,
+		       (n - log->nshadow) * sizeof(uint32_t *));
+		log->nshadow = n;
+	}
+	if (log->shadow[pid] == NULL) {
+		log->shadow[pid] = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
+	}
+
+	/* Only the entries changed since the previous dump */
+	uint32_t * shadow = log->shadow[pid];
+	for (pgit = PAGING_PGN(start); pgit < pgn_end; pgit++) {
+		if (pgd[pgit] != shadow[pgit]) {
+			long args[EV_MAX_ARGS] = {pid, pgit, pgd[pgit]};
+			put_locked(log, EV_PTE, args, NULL);
+			shadow[pgit] = pgd[pgit];
+		}
+	}
+	long args[EV_MAX_ARGS] = {pid, start, end};
+	put_locked(log, EV_PGTBL, args, NULL);
+	pthread_mutex_unlock(&log->lock);
+}
+
+struct evlog * evlog_open(const char * path) {
+	struct evlog * log = calloc(1, sizeof(struct evlog));
+	if ((log->out = fopen(path, "wb")) == NULL) {
+		printf("Cannot open event log %s\n", path);
+		free(log);
+		return NULL;
+	}
+	pthread_mutex_init(&log->lock, NULL);
+	fwrite(EVLOG_MAGIC, 1, strlen(EVLOG_MAGIC), log->out);
+	return log;
+}
+
+void evlog_close(struct evlog * log) {
+	uint32_t pid;
+	fclose(log->out);
+	for (pid = 0; pid < log->nshadow; pid++) {
+		free(log->shadow[pid]);
+	}
+	free(log->shadow);
+	pthread_mutex_destroy(&log->lock);
+	free(log);
+}
@@ -0,0 +1,70 @@
+/* Text rendering of simulator events. Linked into both the simulator,
+ * which prints through it in text mode, and evdecode, so the two can
+ * never disagree on a single byte. */
+
+#include "evlog.h"
+#include "mm.h"
+#include <stdio.h>
+
+const char * ev_fmt[EV_NR] = {
+#define EV_FMT(name, nargs, str, fmt) fmt,
+	OS_EVENTS(EV_FMT)
+#undef EV_FMT
+};
+
+const int ev_nargs[EV_NR] = {
+#define EV_NARGS(name, nargs, str, fmt) nargs,
+	OS_EVENTS(EV_NARGS)
+#undef EV_NARGS
+};
+
+const int ev_has_str[EV_NR] = {
+#define EV_STR(name, nargs, str, fmt) str,
+	OS_EVENTS(EV_STR)
+#undef EV_STR
+};
+
+void render_event(FILE * out, int ev, const long * args, const char * str) {
+	if (ev_has_str[ev]) {
+		fprintf(out, ev_fmt[ev], str, args[0], args[1], args[2],
+			args[3]);
+	}else{
+		fprintf(out, ev_fmt[ev], args[0], args[1], args[2], args[3]);
+	}
+}
+
+void render_pgtbl(FILE * out, uint32_t start, uint32_t end,
+		  const uint32_t * pgd) {
+	int pgn_start = PAGING_PGN(start);
+	int pgn_end = PAGING_PGN(end);
+	int pgit;
+
+	fprintf(out, "print_pgtbl: %d - %d\n", start, end);
+	for (pgit = pgn_start; pgit < pgn_end; pgit++) {
+		fprintf(out, "%08ld: %08x\n",
+			(long)(pgit * sizeof(uint32_t)), pgd[pgit]);
+	}
+
+	fprintf(out, "print_pgtbl: %d - %d\n", start, end);
+	for (pgit = pgn_start; pgit < pgn_end; pgit++) {
+		uint32_t pte = pgd[pgit];
+		if (PAGING_PAGE_PRESENT(pte) &&
+		    !GETVAL(pte, PAGING_PTE_SWAPPED_MASK, 30)) {
+			fprintf(out, "Page Number: %d -> Frame Number: %d\n",
+				pgit, PAGING_PTE_FPN(pte));
+		}
+	}
+	fprintf(out, "================================================================\n");
+}
+
+void render_memdump(FILE * out, const char * storage, int maxsz) {
+	int i;
+	fprintf(out, "PHYSICAL MEMORY DUMP:\n");
+	for (i = 0; i < maxsz; i++) {
+		if (storage[i] != 0) {
+			fprintf(out, "BYTE %08X: %d\n", i, storage[i]);
+		}
+	}
+	fprintf(out, "PHYSICAL MEMORY DUMP:\n");
+	fprintf(out, "================================================================\n");
+}
@@ -0,0 +1,187 @@
+#include "heap.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Array-backed binary heap, the children of entry i at 2i+1 and 2i+2.
+ * Every move of an entry updates heap_idx in its process, so that a
+ * process can be taken out from the middle by swapping the last entry
+ * in and sifting that one up or down. */
+
+#define HEAP_MIN_CAP 16
+
+static inline int ent_less(const struct heap_ent * a, const struct heap_ent * b) {
+	return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+static inline void put_ent(struct proc_heap * h, int i, struct heap_ent e) {
+	h->ent[i] = e;
+	e.proc->heap_idx = i;
+}
+
+static void sift_up(struct proc_heap * h, int i) {
+	struct heap_ent e = h->ent[i];
+	while (i > 0 && ent_less(&e, &h->ent[(i - 1) / 2])) {
+		put_ent(h, i, h->ent[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	put_ent(h, i, e);
+}
+
+static void sift_down(struct proc_heap * h, int i) {
+	struct heap_ent e = h->ent[i];
+	int c;
+	while ((c = 2 * i + 1) < h->nr) {
+		if (c + 1 < h->nr && ent_less(&h->ent[c + 1], &h->ent[c])) {
+			c++;
+		}
+		if (!ent_less(&h->ent[c], &e)) {
+			break;
+		}
+		put_ent(h, i, h->ent[c]);
+		i = c;
+	}
+	put_ent(h, i, e);
+}
+
+void heap_init(struct proc_heap * h) {
+	h->ent = NULL;
+	h->nr = h->cap = 0;
+	h->seq = 0;
+}
+
+void heap_free(struct proc_heap * h) {
+	free(h->ent);
+	heap_init(h);
+}
+
+void heap_insert(struct proc_heap * h, struct pcb_t * proc, uint64_t key,
+		 uint64_t seq) {
+	if (h->nr == h->cap) {
+		int cap = h->cap ? h->cap * 2 : HEAP_MIN_CAP;
+		struct heap_ent * ent = realloc(h->ent, cap * sizeof(*ent));
+		if (ent == NULL) {
+			fprintf(stderr, "Out of memory, cannot enqueue process %d\n",
+				proc->pid);
+			fflush(stderr);
+			return;
+		}
+		h->ent = ent;
+		h->cap = cap;
+	}
+	h->ent[h->nr].key = key;
+	h->ent[h->nr].seq = seq;
+	h->ent[h->nr].proc = proc;
+	sift_up(h, h->nr++);
+	if (h->seq <= seq) {
+		h->seq = seq + 1;
+	}
+}
+
+void heap_push(struct proc_heap * h, struct pcb_t * proc, uint64_t key) {
+	heap_insert(h, proc, key, h->seq);
+}
+
+struct pcb_t * heap_first(const struct proc_heap * h) {
+	return h->nr ? h->ent[0].proc : NULL;
+}
+
+/* Take out entry [i] */
+static void remove_at(struct proc_heap * h, int i) {
+	struct pcb_t * last;
+	h->ent[i].proc->heap_idx = -1;
+	if (i == --h->nr) {
+		return;
+	}
+	last = h->ent[h->nr].proc;
+	put_ent(h, i, h->ent[h->nr]);
+	sift_down(h, i);
+	if (last->heap_idx == i) {
+		sift_up(h, i);
+	}
+}
+
+struct pcb_t * heap_pop(struct proc_heap * h) {
+	struct pcb_t * proc = heap_first(h);
+	if (proc != NULL) {
+		remove_at(h, 0);
+	}
+	return proc;
+}
+
+int heap_has(const struct proc_heap * h, const struct pcb_t * proc) {
+	int i = proc->heap_idx;
+	return i >= 0 && i < h->nr && h->ent[i].proc == proc;
+}
+
+int heap_remove(struct proc_heap * h, struct pcb_t * proc) {
+	if (!heap_has(h, proc)) {
+		return 0;
+	}
+	remove_at(h, proc->heap_idx);
+	return 1;
+}
+
+int heap_remove_many(struct proc_heap * h, struct pcb_t ** procs, int n) {
+	int i, k = 0, depth = 0;
+	for (i = 0; i < n; i++) {
+		k += heap_has(h, procs[i]);
+	}
+	while ((1 << depth) < h->nr) {
+		depth++;
+	}
+	if ((long)k * depth < h->nr) {
+		for (i = 0; i < n; i++) {
+			heap_remove(h, procs[i]);
+		}
+		return k;
+	}
+	/* Clear the entries taken out, close the gaps, then restore the
+	 * heap bottom up. Pops come out in the same order either way, as
+	 * the entries are ordered by (key, seq) */
+	for (i = 0; i < n; i++) {
+		if (heap_has(h, procs[i])) {
+			h->ent[procs[i]->heap_idx].proc = NULL;
+			procs[i]->heap_idx = -1;
+		}
+	}
+	for (i = 0, n = 0; i < h->nr; i++) {
+		if (h->ent[i].proc != NULL) {
+			put_ent(h, n++, h->ent[i]);
+		}
+	}
+	h->nr = n;
+	for (i = n / 2 - 1; i >= 0; i--) {
+		sift_down(h, i);
+	}
+	return k;
+}
+
+/* Index of the first entry from [i] down of key [limit] at most that
+ * [ok] accepts, if it orders before [best]; [best] otherwise */
+static int find_from(const struct proc_heap * h, int i, uint64_t limit,
+		     int (*ok)(const struct pcb_t *, const void *),
+		     const void * arg, int best) {
+	if (i >= h->nr || h->ent[i].key > limit ||
+	    (best >= 0 && !ent_less(&h->ent[i], &h->ent[best]))) {
+		return best;
+	}
+	if (ok(h->ent[i].proc, arg)) {
+		return i;	/* Nothing below comes earlier */
+	}
+	best = find_from(h, 2 * i + 1, limit, ok, arg, best);
+	return find_from(h, 2 * i + 2, limit, ok, arg, best);
+}
+
+struct pcb_t * heap_find(const struct proc_heap * h,
+			 int (*ok)(const struct pcb_t *, const void *),
+			 const void * arg) {
+	return heap_find_upto(h, UINT64_MAX, ok, arg);
+}
+
+struct pcb_t * heap_find_upto(const struct proc_heap * h, uint64_t limit,
+			      int (*ok)(const struct pcb_t *, const void *),
+			      const void * arg) {
+	int i = find_from(h, 0, limit, ok, arg, -1);
+	return i >= 0 ? h->ent[i].proc : NULL;
+}
@@ -0,0 +1,208 @@
+/* Latency report (-m). A process is timestamped as it is loaded, queued
+ * (add_proc(), put_proc()) and dispatched, and what it leaves behind
+ * when it finishes is kept by pid in ctx->procstat. From those, at the
+ * end of the run:
+ *
+ *   wait        slots spent queued, in total
+ *   response    slots from being loaded to being first dispatched
+ *   turnaround  slots from being loaded to having finished
+ *   switches    times dispatched
+ *
+ * are summed up over all processes and by priority level, as log2
+ * histograms with the same buckets as the lateness of deadlines: 0,
+ * then [2^(b-1), 2^b - 1]. The summary goes to the simulation output
+ * and the figures of every process, the levels and the histograms go,
+ * tab separated and one record per line, to the -m file. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os-ctx.h"
+
+#define LAT_BUCKETS 32
+
+enum lat_metric_t {
+	LAT_WAIT,
+	LAT_RESPONSE,
+	LAT_TURNAROUND,
+	LAT_SWITCHES,
+	LAT_METRICS,
+};
+
+static const char * const lat_name[LAT_METRICS] = {
+	"wait", "response", "turnaround", "switches",
+};
+
+struct lat_hist {
+	unsigned long count[LAT_BUCKETS];
+	unsigned long n;
+	uint64_t sum;
+	uint64_t max;
+};
+
+static uint64_t lat_value(const struct proc_stat * st, int m) {
+	switch (m) {
+	case LAT_WAIT:
+		return st->wait;
+	case LAT_RESPONSE:
+		return st->response;
+	case LAT_TURNAROUND:
+		return st->turnaround;
+	default:
+		return st->switches;
+	}
+}
+
+static int lat_bucket(uint64_t v) {
+	int b = 0;
+	while (v != 0 && b < LAT_BUCKETS - 1) {
+		v >>= 1;
+		b++;
+	}
+	return b;
+}
+
+static void hist_add(struct lat_hist * h, uint64_t v) {
+	h->count[lat_bucket(v)]++;
+	h->n++;
+	h->sum += v;
+	if (v > h->max) {
+		h->max = v;
+	}
+}
+
+static double hist_mean(const struct lat_hist * h) {
+	return h->n ? (double)h->sum / h->n : 0.0;
+}
+
+static int cmp_u64(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* [pct] percentile of the [n] sorted [v], by nearest rank */
+static uint64_t percentile(const uint64_t * v, int n, int pct) {
+	long rank = ((long)n * pct + 99) / 100;
+	return n ? v[rank > 0 ? rank - 1 : 0] : 0;
+}
+
+static void write_hist(FILE * f, const char * level, int m,
+		       const struct lat_hist * h) {
+	int b;
+	for (b = 0; b < LAT_BUCKETS; b++) {
+		uint64_t lo = b ? (uint64_t)1 << (b - 1) : 0;
+		uint64_t hi = b ? ((uint64_t)1 << b) - 1 : 0;
+		if (h->count[b] != 0) {
+			fprintf(f, "hist\t%s\t%s\t%lu\t%lu\t%lu\n", level,
+				lat_name[m], (unsigned long)lo,
+				(unsigned long)hi, h->count[b]);
+		}
+	}
+}
+
+static int write_metrics(struct os_ctx * ctx, struct lat_hist * all,
+			 struct lat_hist (*level)[LAT_METRICS]) {
+	FILE * f = fopen(ctx->metrics_path, "w");
+	char name[16];
+	int pid, p, m;
+	if (f == NULL) {
+		perror(ctx->metrics_path);
+		return -1;
+	}
+	fprintf(f, "#proc\tpid\tprio\tarrival\tresponse\twait\tturnaround"
+		"\tswitches\tmigrations\n");
+	for (pid = 1; pid <= ctx->num_processes; pid++) {
+		struct proc_stat * st = &ctx->procstat[pid];
+		if (st->finished) {
+			fprintf(f, "proc\t%d\t%u\t%lu\t%lu\t%lu\t%lu\t%u\t%u\n",
+				pid, st->prio, (unsigned long)st->arrival,
+				(unsigned long)st->response,
+				(unsigned long)st->wait,
+				(unsigned long)st->turnaround, st->switches,
+				st->migrations);
+		}
+	}
+	fprintf(f, "#level\tprio\tprocs\tmean_wait\tmean_response"
+		"\tmean_turnaround\tswitches\n");
+	for (p = 0; p < MAX_PRIO; p++) {
+		struct lat_hist * h = level[p];
+		if (h[LAT_WAIT].n != 0) {
+			fprintf(f, "level\t%d\t%lu\t%.2f\t%.2f\t%.2f\t%lu\n", p,
+				h[LAT_WAIT].n, hist_mean(&h[LAT_WAIT]),
+				hist_mean(&h[LAT_RESPONSE]),
+				hist_mean(&h[LAT_TURNAROUND]),
+				(unsigned long)h[LAT_SWITCHES].sum);
+		}
+	}
+	fprintf(f, "#hist\tlevel\tmetric\tlo\thi\tcount\n");
+	for (m = 0; m < LAT_METRICS; m++) {
+		write_hist(f, "all", m, &all[m]);
+	}
+	for (p = 0; p < MAX_PRIO; p++) {
+		if (level[p][LAT_WAIT].n == 0) {
+			continue;
+		}
+		snprintf(name, sizeof(name), "%d", p);
+		for (m = 0; m < LAT_METRICS; m++) {
+			write_hist(f, name, m, &level[p][m]);
+		}
+	}
+	return fclose(f);
+}
+
+void latency_report(struct os_ctx * ctx) {
+	struct lat_hist all[LAT_METRICS];
+	struct lat_hist (*level)[LAT_METRICS] =
+		calloc(MAX_PRIO, sizeof(*level));
+	uint64_t * v = malloc(sizeof(uint64_t) * (ctx->num_processes + 1));
+	int pid, p, m, n;
+
+	memset(all, 0, sizeof(all));
+	for (pid = 1; pid <= ctx->num_processes; pid++) {
+		struct proc_stat * st = &ctx->procstat[pid];
+		if (!st->finished) {
+			continue;
+		}
+		p = st->prio < MAX_PRIO ? (int)st->prio : MAX_PRIO - 1;
+		for (m = 0; m < LAT_METRICS; m++) {
+			hist_add(&all[m], lat_value(st, m));
+			hist_add(&level[p][m], lat_value(st, m));
+		}
+	}
+
+	os_printf("Latency of %lu finished processes (slots)\n",
+		  all[LAT_WAIT].n);
+	os_printf("\t%-10s %9s %7s %7s %7s %7s\n", "", "mean", "p50", "p90",
+		  "p99", "max");
+	for (m = 0; m < LAT_METRICS; m++) {
+		n = 0;
+		for (pid = 1; pid <= ctx->num_processes; pid++) {
+			if (ctx->procstat[pid].finished) {
+				v[n++] = lat_value(&ctx->procstat[pid], m);
+			}
+		}
+		qsort(v, n, sizeof(uint64_t), cmp_u64);
+		os_printf("\t%-10s %9.2f %7lu %7lu %7lu %7lu\n", lat_name[m],
+			  hist_mean(&all[m]), (unsigned long)percentile(v, n, 50),
+			  (unsigned long)percentile(v, n, 90),
+			  (unsigned long)percentile(v, n, 99),
+			  (unsigned long)all[m].max);
+	}
+	os_printf("\t%-4s %5s %9s %9s %10s %8s\n", "prio", "procs", "wait",
+		  "response", "turnaround", "switches");
+	for (p = 0; p < MAX_PRIO; p++) {
+		struct lat_hist * h = level[p];
+		if (h[LAT_WAIT].n != 0) {
+			os_printf("\t%4d %5lu %9.2f %9.2f %10.2f %8.2f\n", p,
+				  h[LAT_WAIT].n, hist_mean(&h[LAT_WAIT]),
+				  hist_mean(&h[LAT_RESPONSE]),
+				  hist_mean(&h[LAT_TURNAROUND]),
+				  hist_mean(&h[LAT_SWITCHES]));
+		}
+	}
+
+	write_metrics(ctx, all, level);
+	free(v);
+	free(level);
+}
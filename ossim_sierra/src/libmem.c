@@ -18,12 +18,11 @@
  #include "mm.h"
  #include "syscall.h"
  #include "libmem.h"
+ #include "os-ctx.h"
  #include <stdlib.h>
  #include <stdio.h>
  #include <pthread.h>
  
- static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
- 
  /*enlist_vm_freerg_list - add new rg to freerg_list
   *@mm: memory region
   *@rg_elmt: new region
@@ -79,7 +78,8 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
         return -1;
     }
 
-    pthread_mutex_lock(&mmvm_lock); 
+    trace(alloc, caller->pid, rgid, size);
+    pthread_mutex_lock(&cur_ctx->mmvm_lock); 
     if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0)
     {
         caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
@@ -115,7 +115,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
         }
     }
 
-    pthread_mutex_unlock(&mmvm_lock); 
+    pthread_mutex_unlock(&cur_ctx->mmvm_lock); 
     return ret; 
 }
 
@@ -135,6 +135,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
    if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ) {
      return -1;  // rgid không hợp lệ
    }
+   trace(free, caller->pid, rgid, 0);
  
    struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
    if (!cur_vma) {
@@ -200,6 +201,7 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller) {
   uint32_t pte = mm->pgd[pgn];
 
   if (!PAGING_PAGE_PRESENT(pte)) { // Page fault!
+      atomic_fetch_add(&cur_ctx->stats.page_faults, 1);
       int vicpgn = -1;
       int swpfpn = -1;
       int find_victim_ret;
@@ -210,6 +212,7 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller) {
       if (find_victim_ret != 0 || vicpgn < 0) {
           return -1;
       }
+      trace(pgfault, caller->pid, pgn, vicpgn);
 
       get_free_ret = MEMPHY_get_freefp(caller->active_mswp, &swpfpn);
 
@@ -337,7 +340,7 @@ int val = __read(proc, 0, source, offset, &data);
 if (val == 0) {
   *destination = (uint32_t)data; 
 #ifdef IODUMP
-  printf("read region=%d offset=%d value=%d\n", source, offset, data);
+  os_event(EV_READ, source, offset, data, 0);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1);
 #endif
@@ -386,7 +389,7 @@ if (val == 0) {
      uint32_t offset)
  {
  #ifdef IODUMP
-   printf("write region=%d offset=%d value=%d\n", destination, offset, data);
+   os_event(EV_WRITE, destination, offset, data, 0);
  #ifdef PAGETBL_DUMP
    print_pgtbl(proc, 0, -1); 
  #endif
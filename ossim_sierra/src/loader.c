@@ -1,11 +1,10 @@
 
 #include "loader.h"
+#include "os-ctx.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static uint32_t avail_pid = 1;
-
 #define OPT_CALC	"calc"
 #define OPT_ALLOC	"alloc"
 #define OPT_FREE	"free"
@@ -35,8 +34,8 @@ static enum ins_opcode_t get_opcode(char * opt) {
 struct pcb_t * load(const char * path) {
 	/* Create new PCB for the new process */
 	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
+	proc->pid = cur_ctx->avail_pid;
+	cur_ctx->avail_pid++;
 	proc->page_table =
 		(struct page_table_t*)malloc(sizeof(struct page_table_t));
 	proc->bp = PAGE_SIZE;
@@ -98,6 +97,7 @@ struct pcb_t * load(const char * path) {
 			exit(1);
 		}
 	}
+	fclose(file);
 	return proc;
 }
 
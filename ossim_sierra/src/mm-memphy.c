@@ -5,9 +5,12 @@
  */
 
  #include "mm.h"
+ #include "os-ctx.h"
+ #include "replay.h"
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <sys/mman.h>
  
  /*
   *  MEMPHY_mv_csr - move MEMPHY cursor
@@ -105,6 +108,9 @@
    if (addr < 0 || addr >= mp->maxsz)
       return -1;
  
+    if (cur_ctx->evlog != NULL)
+       evlog_mem(cur_ctx->evlog, mp, addr, data);
+
     if (mp->rdmflg)
        mp->storage[addr] = data;
     else /* Sequential access device */
@@ -130,6 +136,7 @@
     /* Initialize head of free framephy list */
     fst = malloc(sizeof(struct framephy_struct));
     fst->fpn = iter;
+    fst->fp_next = NULL;
     mp->free_fp_list = fst;
  
     /* Fill in the rest of the free frame list */
@@ -157,9 +164,13 @@
     struct framephy_struct *fp = mp->free_fp_list;
  
     if (fp == NULL || mp->maxsz <= 0)
+    {
+       rr_value(RR_FRAME, 0);
        return -1;
+    }
  
     *retfpn = fp->fpn;
+    rr_value(RR_FRAME, fp->fpn + 1);
     mp->free_fp_list = fp->fp_next;
  
     /* Free the used frame node */
@@ -192,16 +203,10 @@
   */
  int MEMPHY_dump(struct memphy_struct *mp)
  {
-    printf("PHYSICAL MEMORY DUMP:\n");
-    for (int i = 0; i < mp->maxsz; i++)
-    {
-       if (mp->storage[i] != 0)
-          printf("BYTE %08X: %d\n", i, mp->storage[i]);
-          
-
-    }
-    printf("PHYSICAL MEMORY DUMP:\n");
-    printf("================================================================\n");
+    if (cur_ctx->out != NULL)
+       render_memdump(cur_ctx->out, mp->storage, mp->maxsz);
+    else if (cur_ctx->evlog != NULL)
+       os_event(EV_MEMDUMP, 0, 0, 0, 0);
     return 0;
  }
  
@@ -215,10 +220,14 @@
  {
     mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
     mp->maxsz = max_size;
+    mp->mapped = 0;
     memset(mp->storage, 0, max_size * sizeof(BYTE));
  
+    mp->free_fp_list = NULL;
     MEMPHY_format(mp, PAGING_PAGESZ);
  
+    mp->used_fp_list = NULL;
+
     mp->rdmflg = (randomflg != 0) ? 1 : 0;
  
     if (!mp->rdmflg) /* Not random access device, then it is sequential */
@@ -227,4 +236,29 @@
     return 0;
  }
  
+ /*
+  *  free_memphy - release the storage and frame lists of a MEMPHY
+  *  @mp: memphy struct
+  */
+ void free_memphy(struct memphy_struct *mp)
+ {
+    struct framephy_struct *fp, *next;
+
+    for (fp = mp->free_fp_list; fp != NULL; fp = next)
+    {
+       next = fp->fp_next;
+       free(fp);
+    }
+    for (fp = mp->used_fp_list; fp != NULL; fp = next)
+    {
+       next = fp->fp_next;
+       free(fp);
+    }
+    if (mp->mapped)
+       munmap(mp->storage, mp->maxsz);
+    else
+       free(mp->storage);
+    mp->storage = NULL;
+ }
+
  // #endif
@@ -5,6 +5,7 @@
  */
 
 #include "mm.h"
+#include "os-ctx.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -193,11 +194,13 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller) {
 
   memset(mm->pgd, 0,
          PAGING_MAX_PGN * sizeof(uint32_t));  
+  memset(mm->symrgtbl, 0, sizeof(mm->symrgtbl));
 
   vma0->vm_id = 0;
   vma0->vm_start = 0;
   vma0->vm_end = vma0->vm_start;
   vma0->sbrk = vma0->vm_start;
+  vma0->vm_freerg_list = NULL;
 
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
@@ -244,15 +247,15 @@ int print_list_fp(struct framephy_struct *ifp)
 {
   struct framephy_struct *fp = ifp;
 
-  printf("print_list_fp: ");
-  if (fp == NULL) { printf("NULL list\n"); return -1;}
-  printf("\n");
+  os_printf("print_list_fp: ");
+  if (fp == NULL) { os_printf("NULL list\n"); return -1;}
+  os_printf("\n");
   while (fp != NULL)
   {
-    printf("fp[%d]\n", fp->fpn);
+    os_printf("fp[%d]\n", fp->fpn);
     fp = fp->fp_next;
   }
-  printf("\n");
+  os_printf("\n");
   return 0;
 }
 
@@ -260,15 +263,15 @@ int print_list_rg(struct vm_rg_struct *irg)
 {
   struct vm_rg_struct *rg = irg;
 
-  printf("print_list_rg: ");
-  if (rg == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  os_printf("print_list_rg: ");
+  if (rg == NULL) { os_printf("NULL list\n"); return -1; }
+  os_printf("\n");
   while (rg != NULL)
   {
-    printf("rg[%ld->%ld]\n", rg->rg_start, rg->rg_end);
+    os_printf("rg[%ld->%ld]\n", rg->rg_start, rg->rg_end);
     rg = rg->rg_next;
   }
-  printf("\n");
+  os_printf("\n");
   return 0;
 }
 
@@ -276,76 +279,49 @@ int print_list_vma(struct vm_area_struct *ivma)
 {
   struct vm_area_struct *vma = ivma;
 
-  printf("print_list_vma: ");
-  if (vma == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  os_printf("print_list_vma: ");
+  if (vma == NULL) { os_printf("NULL list\n"); return -1; }
+  os_printf("\n");
   while (vma != NULL)
   {
-    printf("va[%ld->%ld]\n", vma->vm_start, vma->vm_end);
+    os_printf("va[%ld->%ld]\n", vma->vm_start, vma->vm_end);
     vma = vma->vm_next;
   }
-  printf("\n");
+  os_printf("\n");
   return 0;
 }
 
 int print_list_pgn(struct pgn_t *ip)
 {
-  printf("print_list_pgn: ");
-  if (ip == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  os_printf("print_list_pgn: ");
+  if (ip == NULL) { os_printf("NULL list\n"); return -1; }
+  os_printf("\n");
   while (ip != NULL)
   {
-    printf("va[%d]-\n", ip->pgn);
+    os_printf("va[%d]-\n", ip->pgn);
     ip = ip->pg_next;
   }
-  printf("n");
+  os_printf("n");
   return 0;
 }
 
 int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
 {
-  int pgn_start, pgn_end;
-  int pgit;
-  uint32_t pte;
-  if (end == -1)
-  {
-    pgn_start = 0;
-    struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, 0);
-    end = cur_vma->vm_end;
-  }
-  pgn_start = PAGING_PGN(start);
-  pgn_end = PAGING_PGN(end);
-
-  printf("print_pgtbl: %d - %d", start, end);
-  if (caller == NULL) { printf("NULL caller\n"); return -1;}
-  printf("\n");
-
-  for (pgit = pgn_start; pgit < pgn_end; pgit++)
-  {
-    printf("%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
-  }
-
-  printf("print_pgtbl: %d - %d\n", start, end);
+  if (cur_ctx->out == NULL && cur_ctx->evlog == NULL)
+    return 0;
   if (caller == NULL || caller->mm == NULL || caller->mm->pgd == NULL) {
-      printf("Error: print_pgtbl - NULL caller, mm, or pgd\n");
+      os_printf("Error: print_pgtbl - NULL caller, mm, or pgd\n");
       return -1;
   }
-
-  for (pgit = pgn_start; pgit < pgn_end; pgit++)
+  if (end == -1)
   {
-    pte = caller->mm->pgd[pgit];
-
+    struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, 0);
+    end = cur_vma->vm_end;
   }
 
-  for (pgit = pgn_start; pgit < pgn_end; pgit++)
-  {
-    pte = caller->mm->pgd[pgit];
-
-    if (PAGING_PAGE_PRESENT(pte) && !GETVAL(pte, PAGING_PTE_SWAPPED_MASK, 30) ) {
-        int fpn = PAGING_PTE_FPN(pte);
-        printf("Page Number: %d -> Frame Number: %d\n", pgit, fpn);
-    }
-  }
-   printf("================================================================\n");
+  if (cur_ctx->out != NULL)
+    render_pgtbl(cur_ctx->out, start, end, caller->mm->pgd);
+  else
+    evlog_pgtbl(cur_ctx->evlog, caller->pid, caller->mm->pgd, start, end);
   return 0;
 }
@@ -1,159 +1,727 @@
+#include <getopt.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "checkpoint.h"
 #include "cpu.h"
 #include "loader.h"
 #include "mm.h"
+#include "os-ctx.h"
+#include "replay.h"
 #include "sched.h"
 #include "timer.h"
+#include "trace.h"
 
-static int time_slot;
-static int num_cpus;
-static int done = 0;
+__thread struct os_ctx *cur_ctx;
 
-#ifdef MM_PAGING
-static int memramsz;
-static int memswpsz[PAGING_MAX_MMSWP];
-
-struct mmpaging_ld_args {
-  /* A dispatched argument struct to compact many-fields passing to loader */
-  int vmemsz;
-  struct memphy_struct *mram;
-  struct memphy_struct **mswp;
-  struct memphy_struct *active_mswp;
-  int active_mswp_id;
-  struct timer_id_t *timer_id;
+/* Outcome of one slot of a simulated device */
+enum step_t {
+  STEP_BUSY, /* Did some work, wants the next slot */
+  STEP_IDLE, /* Nothing to do before the reported wakeup */
+  STEP_STOP, /* Finished, must be detached from the timer */
 };
-#endif
 
-static struct ld_args {
-  char **path;
-  unsigned long *start_time;
+/* Record how late [proc], which had a deadline, finished */
+static void account_lateness(struct os_ctx *ctx, struct pcb_t *proc) {
+  uint64_t now = current_time();
+  unsigned long late = now > proc->deadline ? now - proc->deadline : 0;
+  unsigned long max = atomic_load(&ctx->stats.max_lateness);
+  int b = 0;
+  while (b < LATENESS_BUCKETS - 1 && late >= (1UL << b)) b++;
+  atomic_fetch_add(&ctx->stats.lateness[b], 1);
+  atomic_fetch_add(&ctx->stats.total_lateness, late);
+  while (late > max &&
+         !atomic_compare_exchange_weak(&ctx->stats.max_lateness, &max, late));
+}
+
+/* Deadlines met and missed, and how late the missed ones were. Printed
+ * at the end of runs in which some process had a deadline */
+static void report_deadlines(struct os_ctx *ctx) {
+  struct os_stats *st = &ctx->stats;
+  unsigned long met = atomic_load(&st->lateness[0]);
+  unsigned long missed = 0;
+  int b;
+  for (b = 1; b < LATENESS_BUCKETS; b++) missed += atomic_load(&st->lateness[b]);
+  if (met + missed == 0) return;
+  os_printf("Deadlines met: %lu, missed: %lu\n", met, missed);
+  if (missed == 0) return;
+  os_printf("Lateness of missed deadlines: mean %.2f, max %lu slots\n",
+            (double)atomic_load(&st->total_lateness) / missed,
+            atomic_load(&st->max_lateness));
+  for (b = 1; b < LATENESS_BUCKETS; b++) {
+    unsigned long n = atomic_load(&st->lateness[b]);
+    unsigned long lo = 1UL << (b - 1), hi = (1UL << b) - 1;
+    if (n == 0) continue;
+    if (b == LATENESS_BUCKETS - 1)
+      os_printf("\t%5lu+     : %lu\n", lo, n);
+    else if (lo == hi)
+      os_printf("\t%5lu      : %lu\n", lo, n);
+    else
+      os_printf("\t%5lu-%-5lu: %lu\n", lo, hi, n);
+  }
+}
+
+/* Printed at the end of runs with -a or some affinity mask */
+static void report_migrations(struct os_ctx *ctx) {
+  if (ctx->warm_tol < 0 && !ctx->has_affinity) return;
+  os_printf("Migrations: %lu in total\n", atomic_load(&ctx->stats.migrations));
+  for (int pid = 1; pid <= ctx->num_processes; pid++)
+    if (ctx->procstat[pid].finished)
+      os_printf("\tPID %2d: %u\n", pid, ctx->procstat[pid].migrations);
+}
+
+/* Printed at the end of runs with -Q adaptive: the levels whose
+ * quantum moved */
+static void report_quanta(struct os_ctx *ctx) {
+  int changed = 0;
+  if (!ctx->adaptive_quantum || ctx->sched_ops->depth == NULL) return;
+  for (int l = 0; l < MAX_PRIO; l++) {
+    int base = ctx->quantum[l] ? ctx->quantum[l] : ctx->time_slot;
+    if (ctx->sched.quantum[l] == base) continue;
+    if (changed++ == 0) os_printf("Adapted quanta:\n");
+    os_printf("\tprio %3d: %d slots, from %d\n", l, ctx->sched.quantum[l],
+              base);
+  }
+  if (changed == 0) os_printf("Adapted quanta: none changed\n");
+}
+
 #ifdef MLQ_SCHED
-  unsigned long *prio;
+static void report_mlfq(struct os_ctx *ctx) {
+  struct sched_state *sched = &ctx->sched;
+  unsigned long total = 0;
+  if (ctx->sched_ops != &mlfq_sched_ops) return;
+  for (int l = 0; l < MAX_PRIO; l++) total += atomic_load(&sched->residency[l]);
+  os_printf("MLFQ: %lu demotions, %lu promotions by aging, %u boosts\n",
+            atomic_load(&sched->mlfq_demotions),
+            atomic_load(&sched->mlfq_promotions),
+            atomic_load(&sched->mlfq_boosts));
+  os_printf("\t%-4s %8s %6s\n", "prio", "slots", "share");
+  for (int l = 0; l < MAX_PRIO; l++) {
+    unsigned long slots = atomic_load(&sched->residency[l]);
+    if (slots != 0)
+      os_printf("\t%4d %8lu %5.1f%%\n", l, slots, 100.0 * slots / total);
+  }
+}
 #endif
-} ld_processes;
-int num_processes;
 
-struct cpu_args {
-  struct timer_id_t *timer_id;
-  int id;
-};
+/* Keep what latency_report() needs of [proc], which finished now */
+static void record_proc(struct os_ctx *ctx, struct pcb_t *proc) {
+  struct proc_stat *st;
+  if (proc->pid > (uint32_t)ctx->num_processes) return;
+  st = &ctx->procstat[proc->pid];
+  st->finished = 1;
+#ifdef MLQ_SCHED
+  st->prio = proc->base_prio;	/* Not where MLFQ left it */
+#else
+  st->prio = proc_prio(proc);
+#endif
+  st->arrival = proc->arrival;
+  st->response = proc->first_run - proc->arrival;
+  st->wait = proc->wait;
+  st->turnaround = current_time() - proc->arrival;
+  st->switches = proc->switches;
+  st->migrations = proc->migrations;
+}
 
-static void *cpu_routine(void *args) {
-  struct timer_id_t *timer_id = ((struct cpu_args *)args)->timer_id;
-  int id = ((struct cpu_args *)args)->id;
-  /* Check for new process in ready queue */
-  int time_left = 0;
-  struct pcb_t *proc = NULL;
-  while (1) {
-    /* Check the status of current process */
-    if (proc == NULL) {
-      /* No process is running, the we load new process from
-       * ready queue */
-      proc = get_proc();
-      if (proc == NULL) {
-        next_slot(timer_id);
-        continue; /* First load failed. skip dummy load */
-      }
-    } else if (proc->pc == proc->code->size) {
-      /* The porcess has finish it job */
-      printf("\tCPU %d: Processed %2d has finished\n", id, proc->pid);
-      free(proc);
-      proc = get_proc();
-      time_left = 0;
-    } else if (time_left == 0) {
-      /* The process has done its job in current time slot */
-      printf("\tCPU %d: Put process %2d to run queue\n", id, proc->pid);
+static enum step_t __cpu_step(struct cpu_args *args) {
+  struct os_ctx *ctx = args->ctx;
+  int id = args->id;
+  struct pcb_t *proc = args->proc;
+  /* A process arrived that should take over from this one */
+  int preempted = ctx->preempt && atomic_exchange(&ctx->cpus[id].preempt, 0) &&
+                  proc != NULL;
+  if (preempted) args->time_left = 0;
+  /* Check the status of current process */
+  if (proc == NULL) {
+    /* No process is running, the we load new process from
+     * ready queue */
+    proc = get_proc();
+  } else if (proc->pc == proc->code->size) {
+    /* The porcess has finish it job */
+    os_event(EV_FINISH, id, proc->pid, 0, 0);
+    atomic_fetch_add(&ctx->stats.finished, 1);
+    trace(finish, proc->pid, 0, 0);
+    if (proc->deadline != UINT64_MAX) account_lateness(ctx, proc);
+    record_proc(ctx, proc);
+    sched_quantum_end(proc, 0);
+    sched_exit(proc);
+    free(proc);
+    proc = get_proc();
+    args->time_left = 0;
+  } else if (args->time_left == 0) {
+    /* The process has done its job in current time slot */
+    if (!preempted) {
+      sched_quantum_end(proc, 1);
+      sched_expire(proc);
+    }
+    if (!preempted && sched_keep(proc)) {
+      /* Still the best pick, stay warm on this CPU */
+      args->time_left = sched_quantum(proc);
+    } else {
+      if (preempted) atomic_fetch_add(&ctx->stats.preemptions, 1);
+      os_event(EV_PUT, id, proc->pid, 0, 0);
       put_proc(proc);
       proc = get_proc();
+      /* Only what this CPU left queued is for a parked one */
+      if (ctx->park && !queue_empty()) wake_idle_cpu(-1, AFFINITY_ANY);
     }
+  }
+  args->proc = proc;
+  if (ctx->preempt)
+    atomic_store(&ctx->cpus[id].rank,
+                 proc != NULL ? ctx->sched_ops->rank(proc) : RANK_IDLE);
 
-    /* Recheck process status after loading new process */
-    if (proc == NULL && done) {
-      /* No process to run, exit */
-      printf("\tCPU %d stopped\n", id);
-      break;
-    } else if (proc == NULL) {
-      /* There may be new processes to run in
-       * next time slots, just skip current slot */
-      next_slot(timer_id);
-      continue;
-    } else if (time_left == 0) {
-      printf("\tCPU %d: Dispatched process %2d\n", id, proc->pid);
-      time_left = time_slot;
+  /* Recheck process status after loading new process */
+  if (proc == NULL && atomic_load(&ctx->done)) {
+    /* No process to run, exit */
+    os_event(EV_STOP, id, 0, 0, 0);
+    return STEP_STOP;
+  } else if (proc == NULL) {
+    /* There may be new processes to run in
+     * next time slots, just skip current slot */
+    atomic_fetch_add(&ctx->stats.idle_slots, 1);
+    if (!queue_empty())
+      atomic_fetch_add(&ctx->stats.idle_ready, 1);
+    return STEP_IDLE;
+  } else if (args->time_left == 0) {
+    os_event(EV_DISPATCH, id, proc->pid, 0, 0);
+    atomic_fetch_add(&ctx->stats.dispatches, 1);
+    if (proc->last_cpu >= 0 && proc->last_cpu != id) {
+      atomic_fetch_add(&ctx->stats.migrations, 1);
+      proc->migrations++;
     }
+    proc->last_cpu = id;
+    if (proc->first_run == UINT64_MAX) proc->first_run = current_time();
+    proc->wait += current_time() - proc->ready_since;
+    proc->switches++;
+    args->time_left = sched_quantum(proc);
+    trace(dispatch, proc->pid, args->time_left, 0);
+  }
+
+  /* Run current process */
+  atomic_fetch_add(&ctx->stats.busy_slots, 1);
+  run(proc);
+  sched_tick(proc);
+  args->time_left--;
+  return STEP_BUSY;
+}
+
+/* Steps are the sections ordered by record/replay (replay.c) */
+static enum step_t cpu_step(struct cpu_args *args) {
+  enum step_t step;
+  rr_enter(args->id);
+  cur_cpu = args->id;
+  step = __cpu_step(args);
+  cur_cpu = -1;
+  rr_exit();
+  return step;
+}
 
-    /* Run current process */
+/* Run ahead the slots that would only execute a CALC of the current
+ * process within its quantum: they read and write nothing but the
+ * process itself, so nobody can tell when they ran. Returns how many
+ * slots were run. */
+static int cpu_run_ahead(struct cpu_args *args) {
+  struct pcb_t *proc = args->proc;
+  int k = 0;
+  /* The loader may flag this CPU in any slot */
+  if (args->ctx->preempt) return 0;
+  while (k < TIMER_AHEAD_SLOTS - 1 && args->time_left > 0 &&
+         proc->pc < proc->code->size &&
+         proc->code->text[proc->pc].opcode == CALC) {
+    atomic_fetch_add(&args->ctx->stats.busy_slots, 1);
     run(proc);
-    time_left--;
-    next_slot(timer_id);
+    sched_tick(proc);
+    args->time_left--;
+    k++;
+  }
+  return k;
+}
+
+/* Bring back CPU [id] if parked. Returns 0 if it was not */
+static int cpu_unpark(struct os_ctx *ctx, int id) {
+  if (!unpark_event(ctx->cpus[id].timer_id)) return 0;
+  atomic_fetch_sub(&ctx->parked, 1);
+  return 1;
+}
+
+void wake_idle_cpu(int last_cpu, uint64_t affinity) {
+  struct os_ctx *ctx = cur_ctx;
+  if (!ctx->park) return;
+  /* Pairs with the one in cpu_park(): either the CPU parking sees the
+   * process queued, or it is seen parked here */
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&ctx->parked) == 0) return;
+  /* Preferably the CPU it last ran on, still warm */
+  if (last_cpu >= 0 && cpu_allowed(affinity, last_cpu) &&
+      cpu_unpark(ctx, last_cpu))
+    return;
+  for (int i = 0; i < ctx->num_cpus; i++)
+    if (cpu_allowed(affinity, i) && cpu_unpark(ctx, i)) return;
+}
+
+/* Wake up every parked CPU, to stop once the loader is done */
+static void wake_all_cpus(struct os_ctx *ctx) {
+  if (!ctx->park) return;
+  atomic_thread_fence(memory_order_seq_cst);
+  for (int i = 0; i < ctx->num_cpus; i++) cpu_unpark(ctx, i);
+}
+
+/* An idle CPU of the threaded engine leaves the slot barrier instead of
+ * arriving idle in every slot, until some device queues a process it
+ * may run or the loader is done. It then steps right after that device,
+ * in the same slot unless it already stepped in it */
+static void cpu_park(struct cpu_args *args) {
+  struct os_ctx *ctx = args->ctx;
+  atomic_fetch_add(&ctx->parked, 1);
+  park_event(args->timer_id);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!queue_empty() || atomic_load(&ctx->done)) cpu_unpark(ctx, args->id);
+  atomic_fetch_add(&ctx->stats.idle_slots, next_slot_park(args->timer_id));
+}
+
+static void *cpu_routine(void *args) {
+  struct timer_id_t *timer_id = ((struct cpu_args *)args)->timer_id;
+  cur_ctx = ((struct cpu_args *)args)->ctx;
+  trace_dev = ((struct cpu_args *)args)->id;
+  enum step_t step;
+  int k;
+  while ((step = cpu_step((struct cpu_args *)args)) != STEP_STOP) {
+    if (step == STEP_IDLE && cur_ctx->park) {
+      cpu_park((struct cpu_args *)args);
+    } else if (step == STEP_IDLE) {
+      next_slot_idle(timer_id, SLOT_NEVER);
+    } else if (cur_ctx->lookahead &&
+               (k = cpu_run_ahead((struct cpu_args *)args)) > 0) {
+      next_slot_ahead(timer_id, k);
+    } else {
+      next_slot(timer_id);
+    }
   }
   detach_event(timer_id);
   pthread_exit(NULL);
 }
 
-static void *ld_routine(void *args) {
-#ifdef MM_PAGING
-  struct memphy_struct *mram = ((struct mmpaging_ld_args *)args)->mram;
-  struct memphy_struct **mswp = ((struct mmpaging_ld_args *)args)->mswp;
-  struct memphy_struct *active_mswp =
-      ((struct mmpaging_ld_args *)args)->active_mswp;
-  struct timer_id_t *timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
-#else
-  struct timer_id_t *timer_id = (struct timer_id_t *)args;
-#endif
-  int i = 0;
-  printf("ld_routine\n");
-  while (i < num_processes) {
-    struct pcb_t *proc = load(ld_processes.path[i]);
+/* The CPU [proc] should take over with -p: the one running the least
+ * urgent process that [proc] beats, among those it may run on. -1 when
+ * one of those is idle, or runs something at least as urgent */
+static int preempt_target(struct os_ctx *ctx, struct pcb_t *proc) {
+  uint64_t worst = ctx->sched_ops->rank(proc);
+  int victim = -1;
+  for (int i = 0; i < ctx->num_cpus; i++) {
+    uint64_t rank = atomic_load(&ctx->cpus[i].rank);
+    if (!proc_allowed(proc, i)) continue;
+    if (rank == RANK_IDLE) return -1;
+    if (rank > worst && !atomic_load(&ctx->cpus[i].preempt)) {
+      worst = rank;
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+static enum step_t __ld_step(struct loader_args *args, uint64_t *wakeup) {
+  struct os_ctx *ctx = args->ctx;
+  struct ld_args *ld = &ctx->ld_processes;
+  int i = ctx->ld_next;
+  if (i >= ctx->num_processes) {
+    atomic_store(&ctx->done, 1);
+    return STEP_STOP;
+  }
+  if (current_time() < ld->start_time[i]) {
+    *wakeup = ld->start_time[i];
+    return STEP_IDLE;
+  }
+  struct pcb_t *proc = load(ld->path[i]);
 #ifdef MLQ_SCHED
-    proc->prio = ld_processes.prio[i];
+  proc->prio = proc->base_prio = ld->prio[i];
+  proc->boosts = 0;
+  proc->level_since = current_time();
+  proc->rq = 0;
+  atomic_init(&proc->queued, RQ_NONE);
 #endif
-    while (current_time() < ld_processes.start_time[i]) {
-      next_slot(timer_id);
-    }
+  proc->deadline =
+      ld->deadline[i] ? current_time() + ld->deadline[i] : UINT64_MAX;
+  proc->affinity = ld->affinity[i];
+  proc->last_cpu = -1;
+  proc->heap_idx = -1;
+  proc->live = NULL;
+  rb_clear(&proc->cfs_node);
+  proc->migrations = 0;
+  proc->arrival = current_time();
+  proc->first_run = UINT64_MAX;
+  proc->wait = 0;
+  proc->switches = 0;
 #ifdef MM_PAGING
-    proc->mm = malloc(sizeof(struct mm_struct));
-    init_mm(proc->mm, proc);
-    proc->mram = mram;
-    proc->mswp = mswp;
-    proc->active_mswp = active_mswp;
+  proc->mm = malloc(sizeof(struct mm_struct));
+  init_mm(proc->mm, proc);
+  proc->mram = args->mram;
+  proc->mswp = args->mswp;
+  proc->active_mswp = args->active_mswp;
 #endif
-    printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-           ld_processes.path[i], proc->pid, ld_processes.prio[i]);
-    add_proc(proc);
-    free(ld_processes.path[i]);
-    i++;
-    next_slot(timer_id);
-  }
-  free(ld_processes.path);
-  free(ld_processes.start_time);
-  done = 1;
+  os_event_str(EV_LOAD, ld->path[i], proc->pid, ld->prio[i]);
+  trace(load, proc->pid, ld->prio[i], 0);
+  int victim = ctx->preempt ? preempt_target(ctx, proc) : -1;
+  if (victim >= 0) sched_place(victim);
+  add_proc(proc);
+  /* Like an IPI: the CPU requeues its process at its next step */
+  if (victim >= 0) atomic_store(&ctx->cpus[victim].preempt, 1);
+  ctx->ld_next++;
+  return STEP_BUSY;
+}
+
+static enum step_t ld_step(struct loader_args *args, uint64_t *wakeup) {
+  enum step_t step;
+  rr_enter(args->ctx->num_cpus);
+  step = __ld_step(args, wakeup);
+  rr_exit();
+  return step;
+}
+
+static void ld_announce(struct os_ctx *ctx) {
+  rr_enter(ctx->num_cpus);
+  os_event(EV_LD_ROUTINE, 0, 0, 0, 0);
+  rr_exit();
+}
+
+static void *ld_routine(void *args) {
+  struct timer_id_t *timer_id = ((struct loader_args *)args)->timer_id;
+  uint64_t wakeup;
+  enum step_t step;
+  cur_ctx = ((struct loader_args *)args)->ctx;
+  trace_dev = cur_ctx->num_cpus;
+  ld_announce(cur_ctx);
+  while ((step = ld_step(args, &wakeup)) != STEP_STOP) {
+    if (step == STEP_IDLE) {
+      next_slot_idle(timer_id, wakeup);
+    } else {
+      next_slot(timer_id);
+    }
+  }
+  wake_all_cpus(cur_ctx);
   detach_event(timer_id);
   pthread_exit(NULL);
 }
 
-static void read_config(const char *path) {
+/* One slot of the loader, followed by its arrival at the slot barrier,
+ * without waiting for the slot to close. Returns 0 once it stopped */
+static int ld_slot(struct loader_args *ld_args) {
+  uint64_t wakeup;
+  trace_dev = ld_args->ctx->num_cpus;
+  switch (ld_step(ld_args, &wakeup)) {
+    case STEP_BUSY:
+      slot_done(ld_args->timer_id);
+      return 1;
+    case STEP_IDLE:
+      slot_idle(ld_args->timer_id, wakeup);
+      return 1;
+    default:
+      detach_event(ld_args->timer_id);
+      return 0;
+  }
+}
+
+/* Same for the CPU [cpu] in slot [now]. A CPU still running ahead has
+ * already arrived and is left alone */
+static int cpu_slot(struct cpu_args *cpu, uint64_t now) {
+  int k;
+  if (cpu->resume > now) return 1;
+  trace_dev = cpu->id;
+  switch (cpu_step(cpu)) {
+    case STEP_BUSY:
+      if (cpu->ctx->lookahead && (k = cpu_run_ahead(cpu)) > 0) {
+        cpu->resume = now + k + 1;
+        slot_ahead(cpu->timer_id, k);
+      } else {
+        slot_done(cpu->timer_id);
+      }
+      return 1;
+    case STEP_IDLE:
+      slot_idle(cpu->timer_id, SLOT_NEVER);
+      return 1;
+    default:
+      detach_event(cpu->timer_id);
+      cpu->timer_id = NULL;
+      return 0;
+  }
+}
+
+/* Sequential engine: the loader and then every CPU, in id order, are
+ * stepped once per slot from the calling thread. There is nothing to
+ * wait for, the last arrival of a slot closes it, so the output only
+ * depends on the configuration. */
+static void run_sequential(struct os_ctx *ctx, struct cpu_args *cpus,
+                           struct loader_args *ld_args) {
+  int running = 0;
+  int ld_running = ld_args->timer_id != NULL;
+  uint64_t now;
+
+  for (int i = 0; i < ctx->num_cpus; i++)
+    if (cpus[i].timer_id != NULL) running++;
+  while (running > 0 || ld_running) {
+    now = current_time();
+    if (now >= ctx->ckpt_slot) {
+      ckpt_save(ctx, ctx->ckpt_path, cpus, ld_args);
+      ctx->ckpt_slot = SLOT_NEVER;
+    }
+    if (ld_running) ld_running = ld_slot(ld_args);
+    for (int i = 0; i < ctx->num_cpus; i++) {
+      if (cpus[i].timer_id != NULL && !cpu_slot(&cpus[i], now)) running--;
+    }
+  }
+}
+
+/* M:N engine: the simulated CPUs are plain state (their cpu_args)
+ * stepped by a fixed pool of host workers. Whoever finishes the last
+ * CPU of a slot steps the loader of the next one, then every worker
+ * claims CPUs off a shared index until all of them have been stepped.
+ * Within a slot the CPUs run in no particular order, as with a thread
+ * per CPU, but nothing ever blocks in the middle of a slot: workers
+ * only wait, all together, for the next slot to be opened. */
+#define POOL_SPIN_MAX 2000
+
+struct pool {
+  struct os_ctx *ctx;
+  struct cpu_args *cpus;
+  struct loader_args *ld_args;
+  int ld_running;
+  int done;          /* Every device stopped */
+  int spin;          /* Busy-wait budget before sleeping */
+  uint64_t now;      /* Slot being stepped */
+  atomic_int next;   /* Next CPU to claim in this slot */
+  atomic_int pending; /* CPUs of this slot not done yet */
+  atomic_int running; /* CPUs not stopped */
+  atomic_uint gen;   /* Slots opened */
+  pthread_mutex_t lock;
+  pthread_cond_t opened;
+};
+
+/* Run by a single worker, once the previous slot is over */
+static void pool_open_slot(struct pool *p) {
+  int running;
+  for (;;) {
+    p->now = current_time();
+    if (p->ld_running) p->ld_running = ld_slot(p->ld_args);
+    if ((running = atomic_load(&p->running)) > 0) {
+      atomic_store(&p->pending, running);
+      atomic_store(&p->next, 0);
+      break;
+    }
+    /* With no CPU left the loader closes every slot by itself */
+    if (!p->ld_running) {
+      p->done = 1;
+      break;
+    }
+  }
+  pthread_mutex_lock(&p->lock);
+  atomic_fetch_add(&p->gen, 1);
+  pthread_cond_broadcast(&p->opened);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void *pool_worker(void *arg) {
+  struct pool *p = (struct pool *)arg;
+  unsigned int gen = 0;
+  int i;
+  cur_ctx = p->ctx;
+  for (;;) {
+    /* Wait for a slot newer than the last one we worked in */
+    for (i = 0; i < p->spin && atomic_load(&p->gen) == gen; i++);
+    if (atomic_load(&p->gen) == gen) {
+      pthread_mutex_lock(&p->lock);
+      while (atomic_load(&p->gen) == gen)
+        pthread_cond_wait(&p->opened, &p->lock);
+      pthread_mutex_unlock(&p->lock);
+    }
+    gen = atomic_load(&p->gen);
+    if (p->done) break;
+
+    while ((i = atomic_fetch_add(&p->next, 1)) < p->ctx->num_cpus) {
+      struct cpu_args *cpu = &p->cpus[i];
+      if (cpu->timer_id == NULL) continue;
+      if (!cpu_slot(cpu, p->now)) atomic_fetch_sub(&p->running, 1);
+      if (atomic_fetch_sub(&p->pending, 1) == 1) pool_open_slot(p);
+    }
+  }
+  return NULL;
+}
+
+static void run_pool(struct os_ctx *ctx, struct cpu_args *cpus,
+                     struct loader_args *ld_args) {
+  int nworkers = ctx->workers < ctx->num_cpus ? ctx->workers : ctx->num_cpus;
+  pthread_t *workers;
+  struct pool p = {
+      .ctx = ctx,
+      .cpus = cpus,
+      .ld_args = ld_args,
+      .ld_running = ld_args->timer_id != NULL,
+  };
+  int running = 0;
+
+  if (nworkers < 1) nworkers = 1;
+  for (int i = 0; i < ctx->num_cpus; i++)
+    if (cpus[i].timer_id != NULL) running++;
+  atomic_init(&p.running, running);
+  p.spin = nworkers > 1 && sysconf(_SC_NPROCESSORS_ONLN) > 1 ? POOL_SPIN_MAX : 0;
+  pthread_mutex_init(&p.lock, NULL);
+  pthread_cond_init(&p.opened, NULL);
+
+  pool_open_slot(&p);
+  workers = (pthread_t *)malloc(nworkers * sizeof(pthread_t));
+  for (int i = 1; i < nworkers; i++)
+    pthread_create(&workers[i], NULL, pool_worker, &p);
+  pool_worker(&p);
+  for (int i = 1; i < nworkers; i++) pthread_join(workers[i], NULL);
+
+  free(workers);
+  pthread_cond_destroy(&p.opened);
+  pthread_mutex_destroy(&p.lock);
+}
+
+/* Per level quanta of a -Q or "quantum=" spec: a comma separated list
+ * of LEVEL:Q or LO-HI:Q ranges, "linear:A:B" for A slots at level 0 up
+ * to B at level MAX_PRIO - 1, and "adaptive". Returns -1 if malformed */
+static int parse_quantum(struct os_ctx *ctx, const char *spec) {
+  char *copy = strdup(spec), *save, *tok;
+  int ret = 0;
+  for (tok = strtok_r(copy, ",", &save); tok != NULL && ret == 0;
+       tok = strtok_r(NULL, ",", &save)) {
+    int lo, hi, q, a, b, n = 0;
+    if (strcmp(tok, "adaptive") == 0) {
+      ctx->adaptive_quantum = 1;
+    } else if (sscanf(tok, "linear:%d:%d%n", &a, &b, &n) == 2 &&
+               tok[n] == '\0' && a > 0 && b > 0) {
+      for (int l = 0; l < MAX_PRIO; l++)
+        ctx->quantum[l] = a + (b - a) * l / (MAX_PRIO - 1);
+    } else {
+      if (sscanf(tok, "%d-%d:%d%n", &lo, &hi, &q, &n) != 3) {
+        n = 0;
+        if (sscanf(tok, "%d:%d%n", &lo, &q, &n) == 2) hi = lo;
+      }
+      if (n == 0 || tok[n] != '\0' || lo < 0 || lo > hi || hi >= MAX_PRIO ||
+          q <= 0) {
+        ret = -1;
+        break;
+      }
+      for (int l = lo; l <= hi; l++) ctx->quantum[l] = q;
+    }
+  }
+  free(copy);
+  return ret;
+}
+
+/* Affinity mask of a "cpus=" field such as "0,2-3", 0 if malformed */
+static uint64_t parse_cpus(const char *list) {
+  uint64_t mask = 0;
+  char *end;
+  while (*list != '\0') {
+    unsigned long lo = strtoul(list, &end, 10), hi = lo;
+    if (end == list) return 0;
+    if (*end == '-') {
+      list = end + 1;
+      hi = strtoul(list, &end, 10);
+      if (end == list) return 0;
+    }
+    if (lo > hi || hi >= 64) return 0;
+    for (; lo <= hi; lo++) mask |= (uint64_t)1 << lo;
+    if (*end == ',') end++;
+    else if (*end != '\0') return 0;
+    list = end;
+  }
+  return mask;
+}
+
+/* The optional fields after the priority of process [i]: a relative
+ * deadline and a "cpus=" affinity mask, in any order */
+static int parse_proc_fields(struct os_ctx *ctx, int i, char *fields) {
+  struct ld_args *ld = &ctx->ld_processes;
+  char *save, *tok, *end;
+  for (tok = strtok_r(fields, " \t\r\n", &save); tok != NULL;
+       tok = strtok_r(NULL, " \t\r\n", &save)) {
+    if (strncmp(tok, "cpus=", 5) == 0) {
+      ld->affinity[i] = parse_cpus(tok + 5);
+      if (ld->affinity[i] == 0) return -1;
+      if (ctx->num_cpus < 64 &&
+          (ld->affinity[i] & (((uint64_t)1 << ctx->num_cpus) - 1)) == 0)
+        return -1;
+      ctx->has_affinity = 1;
+    } else {
+      ld->deadline[i] = strtoul(tok, &end, 10);
+      if (end == tok || *end != '\0') return -1;
+    }
+  }
+  return 0;
+}
+
+/* Option [opt] of the first line of a config file: "quantum=SPEC",
+ * unless -Q gave one, and "step=N", "age=N" and "boost=N" with mlfq */
+static int parse_config_opt(struct os_ctx *ctx, const char *opt) {
+  int *val = NULL;
+  char *end;
+  if (strncmp(opt, "quantum=", 8) == 0)
+    return ctx->quantum_set ? 0 : parse_quantum(ctx, opt + 8);
+#ifdef MLQ_SCHED
+  if (ctx->sched_ops == &mlfq_sched_ops && strncmp(opt, "step=", 5) == 0)
+    val = &ctx->mlfq_step;
+  else if (ctx->sched_ops == &mlfq_sched_ops && strncmp(opt, "age=", 4) == 0)
+    val = &ctx->mlfq_age;
+  else if (ctx->sched_ops == &mlfq_sched_ops &&
+           strncmp(opt, "boost=", 6) == 0)
+    val = &ctx->mlfq_boost;
+#endif
+  if (val == NULL) return -1;
+  opt = strchr(opt, '=') + 1;
+  long v = strtol(opt, &end, 10);
+  if (end == opt || *end != '\0' || v < 0 || v > INT_MAX) return -1;
+  if (val == &ctx->mlfq_step && v == 0) return -1;
+  *val = (int)v;
+  return 0;
+}
+
+int read_config(struct os_ctx *ctx, const char *path) {
   FILE *file;
   if ((file = fopen(path, "r")) == NULL) {
     printf("Cannot find configure file at %s\n", path);
-    exit(1);
+    return -1;
   }
 
   char line[128];
+  char policy[16];
+  char opt[96];
+  int used = 0, n;
   fgets(line, sizeof(line), file);
-  sscanf(line, "%d %d %d", &time_slot, &num_cpus, &num_processes);
+  if (sscanf(line, "%d %d %d %15s%n", &ctx->time_slot, &ctx->num_cpus,
+             &ctx->num_processes, policy, &used) == 4 &&
+      (ctx->sched_ops = sched_find(policy)) == NULL) {
+    printf("Unknown scheduler %s in %s\n", policy, path);
+    fclose(file);
+    return -1;
+  }
+  /* Then options */
+  for (char *p = line + used; used > 0 && sscanf(p, "%95s%n", opt, &n) == 1;
+       p += n) {
+    if (parse_config_opt(ctx, opt) != 0) {
+      printf("Bad option %s in %s\n", opt, path);
+      fclose(file);
+      return -1;
+    }
+  }
 
-  ld_processes.path = (char **)malloc(sizeof(char *) * num_processes);
-  ld_processes.start_time =
-      (unsigned long *)malloc(sizeof(unsigned long) * num_processes);
+  struct ld_args *ld = &ctx->ld_processes;
+  ld->path = (char **)malloc(sizeof(char *) * ctx->num_processes);
+  ld->start_time =
+      (unsigned long *)malloc(sizeof(unsigned long) * ctx->num_processes);
 #ifdef MLQ_SCHED
-  ld_processes.prio =
-      (unsigned long *)malloc(sizeof(unsigned long) * num_processes);
+  ld->prio = (unsigned long *)malloc(sizeof(unsigned long) * ctx->num_processes);
 #endif
+  ld->deadline =
+      (unsigned long *)calloc(ctx->num_processes, sizeof(unsigned long));
+  ld->affinity = (uint64_t *)malloc(sizeof(uint64_t) * ctx->num_processes);
+  for (int i = 0; i < ctx->num_processes; i++) ld->affinity[i] = AFFINITY_ANY;
 
   long cursor = ftell(file);
   int temp[5];
@@ -161,39 +729,122 @@ static void read_config(const char *path) {
       sscanf(line, "%d %d %d %d %d", &temp[0], &temp[1], &temp[2], &temp[3],
              &temp[4]) == 5) {
 #ifdef MM_PAGING
-    memramsz = temp[0];
-    for (int i = 0; i < PAGING_MAX_MMSWP; i++) memswpsz[i] = temp[i + 1];
+    ctx->memramsz = temp[0];
+    for (int i = 0; i < PAGING_MAX_MMSWP; i++) ctx->memswpsz[i] = temp[i + 1];
 #endif
   } else {
     fseek(file, cursor, SEEK_SET);
   }
 
-  for (int i = 0; i < num_processes; i++) {
+  for (int i = 0; i < ctx->num_processes; i++) {
     char proc[100];
-    ld_processes.path[i] = (char *)malloc(100);
-    ld_processes.path[i][0] = '\0';
-    strcat(ld_processes.path[i], "input/proc/");
+    ld->path[i] = (char *)malloc(100);
+    ld->path[i][0] = '\0';
+    strcat(ld->path[i], "input/proc/");
     fgets(line, sizeof(line), file);
+    int fields = 0;
 #ifdef MLQ_SCHED
-    sscanf(line, "%lu %s %lu", &ld_processes.start_time[i], proc,
-           &ld_processes.prio[i]);
+    sscanf(line, "%lu %99s %lu%n", &ld->start_time[i], proc, &ld->prio[i],
+           &fields);
 #else
-    sscanf(line, "%lu %s", &ld_processes.start_time[i], proc);
+    sscanf(line, "%lu %99s%n", &ld->start_time[i], proc, &fields);
 #endif
-    strcat(ld_processes.path[i], proc);
+    strcat(ld->path[i], proc);
+    if (fields > 0 && parse_proc_fields(ctx, i, line + fields) != 0) {
+      printf("Bad deadline or CPU list for process %d in %s\n", i, path);
+      fclose(file);
+      return -1;
+    }
   }
   fclose(file);
+  return 0;
 }
 
-int main(int argc, char *argv[]) {
-  if (argc != 2) {
-    printf("Usage: os [path to configure file]\n");
-    return 1;
-  }
+struct os_ctx *os_ctx_create(void) {
+  struct os_ctx *ctx = (struct os_ctx *)calloc(1, sizeof(struct os_ctx));
+  ctx->avail_pid = 1;
+  ctx->out = stdout;
+  ctx->timer.wakeup = SLOT_NEVER;
+  ctx->ckpt_slot = SLOT_NEVER;
+  ctx->sched_ops = DEFAULT_SCHED_OPS;
+  ctx->warm_tol = -1;
+  ctx->mlfq_step = -1;
+  ctx->mlfq_age = -1;
+  ctx->mlfq_boost = -1;
+  pthread_mutex_init(&ctx->mmvm_lock, NULL);
+  pthread_mutex_init(&ctx->live_lock, NULL);
+  return ctx;
+}
+
+/* Copy the configuration of an instance that has not been run yet */
+struct os_ctx *os_ctx_clone(const struct os_ctx *ctx) {
+  struct os_ctx *copy = os_ctx_create();
+  int n = ctx->num_processes;
 
-  char path[100] = "input/";
-  strcat(path, argv[1]);
-  read_config(path);
+  copy->time_slot = ctx->time_slot;
+  copy->num_cpus = ctx->num_cpus;
+  copy->num_processes = n;
+#ifdef MM_PAGING
+  copy->memramsz = ctx->memramsz;
+  memcpy(copy->memswpsz, ctx->memswpsz, sizeof(copy->memswpsz));
+#endif
+  copy->timer.fast_forward = ctx->timer.fast_forward;
+  copy->lookahead = ctx->lookahead;
+  copy->workers = ctx->workers;
+  copy->percpu_rq = ctx->percpu_rq;
+  copy->sched_ops = ctx->sched_ops;
+  copy->warm_tol = ctx->warm_tol;
+  copy->has_affinity = ctx->has_affinity;
+  copy->preempt = ctx->preempt;
+  memcpy(copy->quantum, ctx->quantum, sizeof(copy->quantum));
+  copy->adaptive_quantum = ctx->adaptive_quantum;
+  copy->mlfq_step = ctx->mlfq_step;
+  copy->mlfq_age = ctx->mlfq_age;
+  copy->mlfq_boost = ctx->mlfq_boost;
+  copy->out = ctx->out;
+
+  copy->ld_processes.path = (char **)malloc(sizeof(char *) * n);
+  copy->ld_processes.start_time =
+      (unsigned long *)malloc(sizeof(unsigned long) * n);
+  memcpy(copy->ld_processes.start_time, ctx->ld_processes.start_time,
+         sizeof(unsigned long) * n);
+#ifdef MLQ_SCHED
+  copy->ld_processes.prio = (unsigned long *)malloc(sizeof(unsigned long) * n);
+  memcpy(copy->ld_processes.prio, ctx->ld_processes.prio,
+         sizeof(unsigned long) * n);
+#endif
+  copy->ld_processes.deadline = (unsigned long *)malloc(sizeof(unsigned long) * n);
+  memcpy(copy->ld_processes.deadline, ctx->ld_processes.deadline,
+         sizeof(unsigned long) * n);
+  copy->ld_processes.affinity = (uint64_t *)malloc(sizeof(uint64_t) * n);
+  memcpy(copy->ld_processes.affinity, ctx->ld_processes.affinity,
+         sizeof(uint64_t) * n);
+  for (int i = 0; i < n; i++)
+    copy->ld_processes.path[i] = strdup(ctx->ld_processes.path[i]);
+  return copy;
+}
+
+void os_ctx_destroy(struct os_ctx *ctx) {
+  for (int i = 0; i < ctx->num_processes; i++) free(ctx->ld_processes.path[i]);
+  free(ctx->ld_processes.path);
+  free(ctx->ld_processes.start_time);
+#ifdef MLQ_SCHED
+  free(ctx->ld_processes.prio);
+#endif
+  free(ctx->ld_processes.deadline);
+  free(ctx->ld_processes.affinity);
+  pthread_mutex_destroy(&ctx->mmvm_lock);
+  pthread_mutex_destroy(&ctx->live_lock);
+  pthread_mutex_destroy(&ctx->sched.queue_lock);
+  pthread_mutex_destroy(&ctx->sched.quantum_lock);
+  free(ctx);
+}
+
+void os_run(struct os_ctx *ctx, int sequential) {
+  struct os_ctx *caller_ctx = cur_ctx;
+  int num_cpus = ctx->num_cpus;
+  int restored = ctx->restore != NULL;
+  cur_ctx = ctx;
 
   pthread_t *cpu = (pthread_t *)malloc(num_cpus * sizeof(pthread_t));
   struct cpu_args *args =
@@ -201,40 +852,294 @@ int main(int argc, char *argv[]) {
   pthread_t ld;
 
   for (int i = 0; i < num_cpus; i++) {
-    args[i].timer_id = attach_event();
+    args[i].ctx = ctx;
+    args[i].timer_id = NULL;
     args[i].id = i;
+    args[i].proc = NULL;
+    args[i].time_left = 0;
+    args[i].resume = 0;
+  }
+  struct loader_args ld_args = {.ctx = ctx};
+  init_scheduler();
+  ctx->procstat = (struct proc_stat *)calloc(ctx->num_processes + 1,
+                                             sizeof(struct proc_stat));
+  /* Policies without a rank, such as cfs, never preempt */
+  if (ctx->sched_ops->rank == NULL) ctx->preempt = 0;
+  ctx->cpus = (struct cpu_view *)malloc(sizeof(struct cpu_view) * num_cpus);
+  for (int i = 0; i < num_cpus; i++) {
+    atomic_init(&ctx->cpus[i].rank, RANK_IDLE);
+    atomic_init(&ctx->cpus[i].preempt, 0);
   }
-  struct timer_id_t *ld_event = attach_event();
-  start_timer();
 
 #ifdef MM_PAGING
   struct memphy_struct mram;
   struct memphy_struct mswp[PAGING_MAX_MMSWP];
-  init_memphy(&mram, memramsz, 1);
-  for (int i = 0; i < PAGING_MAX_MMSWP; i++)
-    init_memphy(&mswp[i], memswpsz[i], 1);
-
-  struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
-  mm_ld_args->timer_id = ld_event;
-  mm_ld_args->mram = &mram;
-  mm_ld_args->mswp = (struct memphy_struct **)&mswp;
-  mm_ld_args->active_mswp = &mswp[0];
-  mm_ld_args->active_mswp_id = 0;
-  pthread_create(&ld, NULL, ld_routine, (void *)mm_ld_args);
-#else
-  pthread_create(&ld, NULL, ld_routine, (void *)ld_event);
+  if (!restored) {
+    init_memphy(&mram, ctx->memramsz, 1);
+    for (int i = 0; i < PAGING_MAX_MMSWP; i++)
+      init_memphy(&mswp[i], ctx->memswpsz[i], 1);
+  }
+
+  ld_args.mram = &mram;
+  ld_args.mswp = (struct memphy_struct **)&mswp;
+  ld_args.active_mswp = &mswp[0];
+  ld_args.active_mswp_id = 0;
 #endif
 
-  init_scheduler();
-  for (int i = 0; i < num_cpus; i++) {
-    pthread_create(&cpu[i], NULL, cpu_routine, (void *)&args[i]);
+  if (restored) {
+    /* Processes, queues and memory as they were at the checkpoint,
+     * only the devices that were still running get attached */
+    if (ckpt_load(ctx, args, &ld_args) != 0) exit(1);
+  } else {
+    for (int i = 0; i < num_cpus; i++) args[i].timer_id = attach_event();
+    ld_args.timer_id = attach_event();
   }
+  for (int i = 0; i < num_cpus; i++) ctx->cpus[i].timer_id = args[i].timer_id;
+  /* Only a thread per CPU waits at the barrier while idle. Recording and
+   * replaying keep every CPU stepping, as which one is woken up is not
+   * logged */
+  ctx->park = !sequential && ctx->workers == 0 && ctx->rr == NULL;
+  atomic_init(&ctx->parked, 0);
+#ifdef MM_PAGING
+  if (ctx->evlog != NULL) evlog_set_ram(ctx->evlog, &mram);
+#endif
+  start_timer();
+  /* CPUs still running ahead have already arrived in this slot */
+  for (int i = 0; i < num_cpus; i++)
+    if (args[i].timer_id != NULL && args[i].resume > current_time())
+      atomic_fetch_sub(&ctx->timer.remaining, 1);
 
-  for (int i = 0; i < num_cpus; i++) {
-    pthread_join(cpu[i], NULL);
+  /* A restored run goes on right after the output of the slot it
+   * was checkpointed in */
+  if (!restored) os_event(EV_SLOT, current_time(), 0, 0, 0);
+
+  if (sequential) {
+    if (!restored) ld_announce(ctx);
+    run_sequential(ctx, args, &ld_args);
+    if (ctx->ckpt_slot != SLOT_NEVER)
+      fprintf(stderr, "Simulation ended before slot %lu, no checkpoint\n",
+              (unsigned long)ctx->ckpt_slot);
+  } else if (ctx->workers > 0) {
+    ld_announce(ctx);
+    run_pool(ctx, args, &ld_args);
+  } else {
+    pthread_create(&ld, NULL, ld_routine, &ld_args);
+    for (int i = 0; i < num_cpus; i++) {
+      pthread_create(&cpu[i], NULL, cpu_routine, (void *)&args[i]);
+    }
+
+    for (int i = 0; i < num_cpus; i++) {
+      pthread_join(cpu[i], NULL);
+    }
+    pthread_join(ld, NULL);
   }
-  pthread_join(ld, NULL);
 
+  report_deadlines(ctx);
+  report_migrations(ctx);
+  report_quanta(ctx);
+#ifdef MLQ_SCHED
+  report_mlfq(ctx);
+#endif
+  if (ctx->preempt)
+    os_printf("Preemptions on arrival: %lu\n",
+              atomic_load(&ctx->stats.preemptions));
+  if (ctx->metrics_path != NULL) latency_report(ctx);
   stop_timer();
-  return 0;
+#ifdef MM_PAGING
+  free_memphy(&mram);
+  for (int i = 0; i < PAGING_MAX_MMSWP; i++) free_memphy(&mswp[i]);
+#endif
+  finish_scheduler();
+  free(ctx->procstat);
+  ctx->procstat = NULL;
+  free(ctx->cpus);
+  ctx->cpus = NULL;
+  free(args);
+  free(cpu);
+  cur_ctx = caller_ctx;
+}
+
+static void usage(void) {
+  printf("Usage: os [options] [path to configure file]\n");
+  printf("  -f, --fast-forward  skip time slots in which nothing can run\n");
+  printf("  -s, --sequential    step all CPUs from a single host thread\n");
+  printf("  -l, --lookahead     let CPUs run ahead through CALC instructions\n");
+  printf("  -w, --workers=N     run the CPUs on N host threads (0: one per core)\n");
+  printf("  -q, --percpu        give every CPU its own run queue, with stealing\n");
+  printf("  -a, --affinity=TOL  keep processes on the CPU they last ran on\n");
+  printf("                      unless one TOL levels or slots ahead waits\n");
+  printf("  -Q, --quantum=SPEC  quantum of each priority level, e.g. 0-9:2,10-139:8,\n");
+  printf("                      linear:2:10, plus adaptive to adjust them\n");
+  printf("  -p, --preempt       let arrivals preempt a CPU running a less urgent\n");
+  printf("                      process at once\n");
+  printf("  -m, --metrics=FILE  print latency statistics at the end of the run\n");
+  printf("                      and write them to FILE\n");
+  printf("  -S, --sweep=SPEC    run a grid of variants of the configuration\n");
+  printf("  -j, --jobs=N        host threads used by --sweep\n");
+  printf("  -t, --trace=LIST    enable tracepoints (comma separated, or all)\n");
+  printf("  -T, --trace-file=F  write the trace to F instead of stderr\n");
+  printf("  -b, --binlog=FILE   log binary events to FILE (see evdecode)\n");
+  printf("  -c, --checkpoint=SLOT:FILE\n");
+  printf("                      save the simulation state at SLOT to FILE\n");
+  printf("  -r, --restore=FILE  resume from a checkpoint, without a config\n");
+  printf("  -R, --record=FILE   log the order of the steps of the devices\n");
+  printf("  -P, --replay=FILE   replay a run recorded with -R\n");
+  printf("Checkpoints are taken and resumed by the sequential engine (-s)\n");
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option long_opts[] = {
+      {"fast-forward", no_argument, NULL, 'f'},
+      {"sequential", no_argument, NULL, 's'},
+      {"lookahead", no_argument, NULL, 'l'},
+      {"workers", required_argument, NULL, 'w'},
+      {"percpu", no_argument, NULL, 'q'},
+      {"affinity", required_argument, NULL, 'a'},
+      {"quantum", required_argument, NULL, 'Q'},
+      {"preempt", no_argument, NULL, 'p'},
+      {"metrics", required_argument, NULL, 'm'},
+      {"sweep", required_argument, NULL, 'S'},
+      {"jobs", required_argument, NULL, 'j'},
+      {"trace", required_argument, NULL, 't'},
+      {"trace-file", required_argument, NULL, 'T'},
+      {"binlog", required_argument, NULL, 'b'},
+      {"checkpoint", required_argument, NULL, 'c'},
+      {"restore", required_argument, NULL, 'r'},
+      {"record", required_argument, NULL, 'R'},
+      {"replay", required_argument, NULL, 'P'},
+      {NULL, 0, NULL, 0},
+  };
+  struct os_ctx *ctx = os_ctx_create();
+  const char *sweep_spec = NULL;
+  const char *trace_path = NULL;
+  const char *binlog_path = NULL;
+  const char *restore_path = NULL;
+  const char *record_path = NULL;
+  const char *replay_path = NULL;
+  char *end;
+  int sequential = 0;
+  int jobs = 0;
+  int opt;
+  cur_ctx = ctx;
+  while ((opt = getopt_long(argc, argv, "fslw:qa:Q:pm:S:j:t:T:b:c:r:R:P:", long_opts, NULL)) != -1) {
+    switch (opt) {
+      case 'f':
+        set_fast_forward(1);
+        break;
+      case 's':
+        sequential = 1;
+        break;
+      case 'l':
+        ctx->lookahead = 1;
+        break;
+      case 'w':
+        ctx->workers = atoi(optarg);
+        if (ctx->workers <= 0) ctx->workers = sysconf(_SC_NPROCESSORS_ONLN);
+        break;
+      case 'q':
+        ctx->percpu_rq = 1;
+        break;
+      case 'a':
+        ctx->warm_tol = strtol(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || ctx->warm_tol < 0) {
+          usage();
+          return 1;
+        }
+        break;
+      case 'Q':
+        if (parse_quantum(ctx, optarg) != 0) {
+          printf("Bad quantum specification '%s'\n", optarg);
+          return 1;
+        }
+        ctx->quantum_set = 1;
+        break;
+      case 'p':
+        ctx->preempt = 1;
+        break;
+      case 'm':
+        ctx->metrics_path = optarg;
+        break;
+      case 'S':
+        sweep_spec = optarg;
+        break;
+      case 'j':
+        jobs = atoi(optarg);
+        break;
+      case 't':
+        if (trace_enable(optarg) != 0) {
+          printf("Unknown tracepoint in '%s'\n", optarg);
+          return 1;
+        }
+        break;
+      case 'T':
+        trace_path = optarg;
+        break;
+      case 'b':
+        binlog_path = optarg;
+        break;
+      case 'c':
+        ctx->ckpt_slot = strtoull(optarg, &end, 10);
+        if (end == optarg || *end != ':' || end[1] == '\0') {
+          usage();
+          return 1;
+        }
+        ctx->ckpt_path = end + 1;
+        sequential = 1;
+        break;
+      case 'r':
+        restore_path = optarg;
+        sequential = 1;
+        break;
+      case 'R':
+        record_path = optarg;
+        break;
+      case 'P':
+        replay_path = optarg;
+        break;
+      default:
+        usage();
+        return 1;
+    }
+  }
+  if (optind != argc - (restore_path == NULL) ||
+      (sweep_spec != NULL &&
+       (restore_path != NULL || ctx->ckpt_slot != SLOT_NEVER ||
+        ctx->metrics_path != NULL ||
+        record_path != NULL || replay_path != NULL)) ||
+      (replay_path != NULL &&
+       (sequential || record_path != NULL))) {
+    usage();
+    return 1;
+  }
+
+  if (restore_path != NULL) {
+    if (ckpt_open(ctx, restore_path) != 0) return 1;
+  } else {
+    char path[100] = "input/";
+    strcat(path, argv[optind]);
+    if (read_config(ctx, path) != 0) return 1;
+  }
+
+  int ret = 0;
+  if (sweep_spec != NULL) {
+    ret = run_sweep(ctx, sweep_spec, jobs);
+  } else {
+    if (trace_enabled() && trace_start(ctx, trace_path) != 0) return 1;
+    if (binlog_path != NULL) {
+      if ((ctx->evlog = evlog_open(binlog_path)) == NULL) return 1;
+      ctx->out = NULL;
+    }
+    if (record_path != NULL && rr_record(ctx, record_path) != 0) return 1;
+    if (replay_path != NULL) {
+      /* Any order can only be replayed with a thread per device */
+      if (rr_replay(ctx, replay_path) != 0) return 1;
+      ctx->workers = 0;
+    }
+    os_run(ctx, sequential);
+    if (ctx->rr != NULL && rr_finish(ctx) != 0) ret = 1;
+    if (ctx->trace != NULL) trace_stop(ctx);
+    if (ctx->evlog != NULL) evlog_close(ctx->evlog);
+  }
+  os_ctx_destroy(ctx);
+  return ret;
 }
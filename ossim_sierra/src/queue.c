@@ -1,8 +1,40 @@
 #include "queue.h"
 
+#include <threads.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#define QUEUE_MIN_CAP 16
+
+void queue_init(struct queue_t* q) {
+  q->proc = NULL;
+  q->head = q->size = q->cap = 0;
+}
+
+void queue_free(struct queue_t* q) {
+  free(q->proc);
+  queue_init(q);
+}
+
+/* Slot of the [i]th process from the head */
+static inline int queue_slot(const struct queue_t* q, int i) {
+  i += q->head;
+  return i < q->cap ? i : i - q->cap;
+}
+
+/* Double the slots, unwrapping the ring at the start of the new ones */
+static int queue_grow(struct queue_t* q) {
+  int cap = q->cap ? q->cap * 2 : QUEUE_MIN_CAP;
+  struct pcb_t** proc = malloc(cap * sizeof(struct pcb_t*));
+  if (proc == NULL) return -1;
+  for (int i = 0; i < q->size; i++) proc[i] = q->proc[queue_slot(q, i)];
+  free(q->proc);
+  q->proc = proc;
+  q->head = 0;
+  q->cap = cap;
+  return 0;
+}
+
 /**
  * @brief Check if a queue is empty.
  *
@@ -19,81 +51,190 @@ int empty(struct queue_t* q) {
 /**
  * @brief Add a process to the end of a queue.
  *
- * This function enqueues a process at the end of the given queue.
- * If the queue is full or parameters are invalid, the function does nothing.
+ * This function enqueues a process at the end of the given queue,
+ * doubling its slots first if they are all taken. If parameters are
+ * invalid or memory runs out, the function does nothing.
  *
  * @param q Pointer to the queue.
  * @param proc Pointer to the process to add.
  */
 void enqueue(struct queue_t* q, struct pcb_t* proc) {
   if (q == NULL || proc == NULL) return;
-  if (q->size >= MAX_QUEUE_SIZE) {
-    fprintf(stderr, "Queue is full, cannot enqueue process %d\n", proc->pid);
+  if (q->size == q->cap && queue_grow(q) != 0) {
+    fprintf(stderr, "Out of memory, cannot enqueue process %d\n", proc->pid);
     fflush(stderr);
     return;
   }
+  q->proc[queue_slot(q, q->size)] = proc;
+  q->size++;
+}
 
-  if (q->size < 0) q->size = 0;
+struct pcb_t* queue_pop(struct queue_t* q) {
+  if (q == NULL || q->size <= 0) return NULL;
+  struct pcb_t* proc = q->proc[q->head];
+  q->head = queue_slot(q, 1);
+  q->size--;
+  return proc;
+}
 
-  q->proc[q->size] = proc;
-  q->size++;
+struct pcb_t* queue_at(struct queue_t* q, int i) {
+  return q->proc[queue_slot(q, i)];
 }
 
-/**
- * @brief Remove and return the process with the highest priority from a queue.
+/* Closes the gap from the nearer end, so popping the head is O(1) */
+struct pcb_t* queue_remove_at(struct queue_t* q, int i) {
+  int slot = queue_slot(q, i);
+  struct pcb_t* proc = q->proc[slot];
+  if (i < q->size / 2) {
+    for (; slot != q->head; slot = slot ? slot - 1 : q->cap - 1)
+      q->proc[slot] = q->proc[slot ? slot - 1 : q->cap - 1];
+    q->head = queue_slot(q, 1);
+  } else {
+    int last = queue_slot(q, q->size - 1);
+    for (; slot != last; slot = slot + 1 < q->cap ? slot + 1 : 0)
+      q->proc[slot] = q->proc[slot + 1 < q->cap ? slot + 1 : 0];
+  }
+  q->size--;
+  return proc;
+}
+
+/* Lock-free bounded MPMC ring, after Dmitry Vyukov's design. Every cell
+ * carries a sequence number telling which lap of the ring it is ready
+ * for: a cell at position pos can be pushed to when seq == pos and
+ * popped from when seq == pos + 1. A thread claims a position by moving
+ * tail (push) or head (pop) on with a CAS, fills or empties the cell,
+ * then publishes it by moving seq on to the next state. Producers and
+ * consumers only ever contend on the index they share.
  *
- * This function finds and removes the process with the highest priority
- * (lowest priority value) from the queue. If MLQ_SCHED is defined, it uses
- * the dynamic priority field. The queue is updated accordingly.
+ * A thread preempted between its CAS and its publish holds up that one
+ * cell: a pop arriving at it reports the ring empty, which only delays
+ * the process, while a push waits for it, so that a process is only
+ * ever turned away by a ring that really is full.
  *
- * @param q Pointer to the queue.
- * @return Pointer to the removed process, or NULL if the queue is empty.
- */
-struct pcb_t* dequeue(struct queue_t* q) {
-  /* TODO: return a pcb whose prioprity is the highest
-   * in the queue [q] and remember to remove it from q
-   * */
-  if (q == NULL || q->size <= 0) return NULL;
+ * A process turned away goes to the spill queue, under spill_lock, and
+ * so do all the processes pushed after it as long as spilled is not 0.
+ * Pops move the head of the spill queue into the cells as they free up,
+ * so the cells always hold the oldest processes and the ring stays
+ * first in, first out. Only rings holding more processes than they have
+ * cells take the lock. */
 
-  // Validate the queue size // FB: do we really need this check?
-  if (q->size > MAX_QUEUE_SIZE) {
-    q->size = MAX_QUEUE_SIZE;
+void ring_init(struct ring_t* r, int procs) {
+  size_t i, cells = RING_MIN_CELLS;
+  while (cells < (size_t)procs && cells < RING_MAX_CELLS) cells *= 2;
+  r->cell = malloc(cells * sizeof(struct ring_cell_t));
+  r->cells = cells;
+  for (i = 0; i < cells; i++) {
+    atomic_init(&r->cell[i].seq, i);
+    r->cell[i].proc = NULL;
   }
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+  atomic_init(&r->spilled, 0);
+  pthread_mutex_init(&r->spill_lock, NULL);
+  queue_init(&r->spill);
+}
 
-  // Find the process with highest priority (lowest number)
-  int highest_priority_idx = 0;
-  for (int i = 1; i < q->size; i++) {
-    if (q->proc[i] == NULL) {
-      continue;
-    }
-    if (q->proc[highest_priority_idx] == NULL) {
-      highest_priority_idx = i;
-      continue;
-    }
-#ifdef MLQ_SCHED
-    if (q->proc[i]->prio < q->proc[highest_priority_idx]->prio) {
-      highest_priority_idx = i;
+void ring_destroy(struct ring_t* r) {
+  free(r->cell);
+  queue_free(&r->spill);
+  pthread_mutex_destroy(&r->spill_lock);
+}
+
+/* Returns -1 if the cells are full */
+static int cells_push(struct ring_t* r, struct pcb_t* proc) {
+  size_t pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  struct ring_cell_t* cell;
+  for (;;) {
+    cell = &r->cell[pos & (r->cells - 1)];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&r->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (dif < 0) {
+      /* The cell still holds the process of the previous lap. Either
+       * the ring is full, or a pop has claimed the cell but not yet
+       * handed it back: wait for that one rather than fail */
+      if (pos - atomic_load_explicit(&r->head, memory_order_acquire) >=
+          r->cells)
+        return -1;
+      thrd_yield();
+      pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    } else {
+      pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
     }
-#else
-    if (q->proc[i]->priority < q->proc[highest_priority_idx]->priority) {
-      highest_priority_idx = i;
+  }
+  cell->proc = proc;
+  atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+  return 0;
+}
+
+static struct pcb_t* cells_pop(struct ring_t* r) {
+  size_t pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+  struct ring_cell_t* cell;
+  for (;;) {
+    cell = &r->cell[pos & (r->cells - 1)];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (dif < 0) {
+      return NULL; /* Not pushed to yet */
+    } else {
+      pos = atomic_load_explicit(&r->head, memory_order_relaxed);
     }
-#endif
   }
+  struct pcb_t* proc = cell->proc;
+  atomic_store_explicit(&cell->seq, pos + r->cells, memory_order_release);
+  return proc;
+}
 
-  // Safety check
-  if (q->proc[highest_priority_idx] == NULL) {
-    return NULL;
+void ring_push(struct ring_t* r, struct pcb_t* proc) {
+  if (atomic_load_explicit(&r->spilled, memory_order_acquire) == 0 &&
+      cells_push(r, proc) == 0)
+    return;
+  pthread_mutex_lock(&r->spill_lock);
+  /* The spill queue may have drained in the meantime */
+  if (r->spill.size > 0 || cells_push(r, proc) != 0) {
+    enqueue(&r->spill, proc);
+    atomic_store_explicit(&r->spilled, r->spill.size, memory_order_release);
   }
+  pthread_mutex_unlock(&r->spill_lock);
+}
 
-  // Save the highest priority process
-  struct pcb_t* highest_proc = q->proc[highest_priority_idx];
+/* Move what fits of the spill queue into the cells */
+static void ring_refill(struct ring_t* r) {
+  pthread_mutex_lock(&r->spill_lock);
+  while (r->spill.size > 0 && cells_push(r, queue_at(&r->spill, 0)) == 0)
+    queue_pop(&r->spill);
+  atomic_store_explicit(&r->spilled, r->spill.size, memory_order_release);
+  pthread_mutex_unlock(&r->spill_lock);
+}
 
-  // Remove the process from the queue and shift other processes
-  for (int i = highest_priority_idx; i < q->size - 1; i++) {
-    q->proc[i] = q->proc[i + 1];
+struct pcb_t* ring_pop(struct ring_t* r) {
+  struct pcb_t* proc = cells_pop(r);
+  if (atomic_load_explicit(&r->spilled, memory_order_acquire) > 0) {
+    ring_refill(r);
+    if (proc == NULL) proc = cells_pop(r);
   }
+  return proc;
+}
 
-  q->size--;
-  return highest_proc;
+int ring_size(struct ring_t* r) {
+  size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  int spilled = atomic_load_explicit(&r->spilled, memory_order_acquire);
+  return (tail > head ? (int)(tail - head) : 0) + spilled;
+}
+
+struct pcb_t* ring_peek(struct ring_t* r, int i) {
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  if ((size_t)i < tail - head) return r->cell[(head + i) & (r->cells - 1)].proc;
+  return queue_at(&r->spill, i - (int)(tail - head));
 }
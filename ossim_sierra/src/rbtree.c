@@ -0,0 +1,239 @@
+#include "rbtree.h"
+
+/* Red-black tree with parent pointers and NULL leaves, rebalanced as in
+ * CLRS (chapter 13). A NULL child counts as black. */
+
+static void rotate_left(struct rb_root * t, struct rb_node * x) {
+	struct rb_node * y = x->right;
+	x->right = y->left;
+	if (y->left != NULL) {
+		y->left->parent = x;
+	}
+	y->parent = x->parent;
+	if (x->parent == NULL) {
+		t->root = y;
+	}else if (x == x->parent->left) {
+		x->parent->left = y;
+	}else{
+		x->parent->right = y;
+	}
+	y->left = x;
+	x->parent = y;
+}
+
+static void rotate_right(struct rb_root * t, struct rb_node * x) {
+	struct rb_node * y = x->left;
+	x->left = y->right;
+	if (y->right != NULL) {
+		y->right->parent = x;
+	}
+	y->parent = x->parent;
+	if (x->parent == NULL) {
+		t->root = y;
+	}else if (x == x->parent->right) {
+		x->parent->right = y;
+	}else{
+		x->parent->left = y;
+	}
+	y->right = x;
+	x->parent = y;
+}
+
+static inline int is_red(const struct rb_node * n) {
+	return n != NULL && n->red;
+}
+
+void rb_insert(struct rb_root * t, struct rb_node * node,
+	       int (*less)(const struct rb_node * a, const struct rb_node * b)) {
+	struct rb_node ** link = &t->root;
+	struct rb_node * parent = NULL;
+	struct rb_node * z = node;
+	int leftmost = 1;
+
+	while (*link != NULL) {
+		parent = *link;
+		if (less(node, parent)) {
+			link = &parent->left;
+		}else{
+			link = &parent->right;
+			leftmost = 0;
+		}
+	}
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->red = 1;
+	*link = node;
+	if (leftmost) {
+		t->first = node;
+	}
+
+	while (is_red(z->parent)) {
+		struct rb_node * p = z->parent;
+		struct rb_node * g = p->parent;	/* The root is black */
+		struct rb_node * u;
+		if (p == g->left) {
+			u = g->right;
+			if (is_red(u)) {
+				p->red = u->red = 0;
+				g->red = 1;
+				z = g;
+				continue;
+			}
+			if (z == p->right) {
+				rotate_left(t, p);
+				z = p;
+				p = z->parent;
+			}
+			p->red = 0;
+			g->red = 1;
+			rotate_right(t, g);
+		}else{
+			u = g->left;
+			if (is_red(u)) {
+				p->red = u->red = 0;
+				g->red = 1;
+				z = g;
+				continue;
+			}
+			if (z == p->left) {
+				rotate_right(t, p);
+				z = p;
+				p = z->parent;
+			}
+			p->red = 0;
+			g->red = 1;
+			rotate_left(t, g);
+		}
+	}
+	t->root->red = 0;
+}
+
+/* Put [v] where [u] hangs */
+static void transplant(struct rb_root * t, struct rb_node * u,
+		       struct rb_node * v) {
+	if (u->parent == NULL) {
+		t->root = v;
+	}else if (u == u->parent->left) {
+		u->parent->left = v;
+	}else{
+		u->parent->right = v;
+	}
+	if (v != NULL) {
+		v->parent = u->parent;
+	}
+}
+
+/* [x], possibly NULL, hangs below [parent] and carries an extra black */
+static void erase_fixup(struct rb_root * t, struct rb_node * x,
+			struct rb_node * parent) {
+	struct rb_node * w;
+	while (x != t->root && !is_red(x)) {
+		if (x == parent->left) {
+			w = parent->right;
+			if (is_red(w)) {
+				w->red = 0;
+				parent->red = 1;
+				rotate_left(t, parent);
+				w = parent->right;
+			}
+			if (!is_red(w->left) && !is_red(w->right)) {
+				w->red = 1;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+			if (!is_red(w->right)) {
+				w->left->red = 0;
+				w->red = 1;
+				rotate_right(t, w);
+				w = parent->right;
+			}
+			w->red = parent->red;
+			parent->red = 0;
+			w->right->red = 0;
+			rotate_left(t, parent);
+		}else{
+			w = parent->left;
+			if (is_red(w)) {
+				w->red = 0;
+				parent->red = 1;
+				rotate_right(t, parent);
+				w = parent->left;
+			}
+			if (!is_red(w->left) && !is_red(w->right)) {
+				w->red = 1;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+			if (!is_red(w->left)) {
+				w->right->red = 0;
+				w->red = 1;
+				rotate_left(t, w);
+				w = parent->left;
+			}
+			w->red = parent->red;
+			parent->red = 0;
+			w->left->red = 0;
+			rotate_right(t, parent);
+		}
+		x = t->root;
+	}
+	if (x != NULL) {
+		x->red = 0;
+	}
+}
+
+void rb_erase(struct rb_root * t, struct rb_node * z) {
+	struct rb_node * child;
+	struct rb_node * parent;
+	int red;
+
+	if (t->first == z) {
+		t->first = rb_next(z);
+	}
+	if (z->left == NULL || z->right == NULL) {
+		child = z->left != NULL ? z->left : z->right;
+		parent = z->parent;
+		red = z->red;
+		transplant(t, z, child);
+	}else{
+		/* Swap in the successor, the leftmost node right of [z] */
+		struct rb_node * y = z->right;
+		while (y->left != NULL) {
+			y = y->left;
+		}
+		red = y->red;
+		child = y->right;
+		if (y->parent == z) {
+			parent = y;
+		}else{
+			parent = y->parent;
+			transplant(t, y, child);
+			y->right = z->right;
+			y->right->parent = y;
+		}
+		transplant(t, z, y);
+		y->left = z->left;
+		y->left->parent = y;
+		y->red = z->red;
+	}
+	if (!red) {
+		erase_fixup(t, child, parent);
+	}
+	rb_clear(z);
+}
+
+struct rb_node * rb_next(const struct rb_node * node) {
+	if (node->right != NULL) {
+		node = node->right;
+		while (node->left != NULL) {
+			node = node->left;
+		}
+		return (struct rb_node *)node;
+	}
+	while (node->parent != NULL && node == node->parent->right) {
+		node = node->parent;
+	}
+	return node->parent;
+}
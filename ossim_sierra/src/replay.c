@@ -0,0 +1,254 @@
+#include "replay.h"
+#include "os-ctx.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Log: RR_MAGIC, then records of one varint each, (value << 2) | kind.
+ * The first record gives the number of devices. A section costs one
+ * STEP record, plus one per choice it made, a byte or two each.
+ *
+ * Sections hold rr->lock from rr_enter() to rr_exit(). When recording,
+ * that makes the logged order the order in which the steps really ran.
+ * When replaying, a device entering out of turn waits on its own
+ * condition variable until the section before its turn signals it.
+ * A step never blocks on another device, so whatever order a run took
+ * can be taken again as long as each device has a host thread of its
+ * own: replays always use the thread per CPU engine.
+ *
+ * A replay that stops matching the log (other config, other inputs,
+ * other build) is reported once, then runs on without forcing. */
+
+#define RR_MAGIC "OSRRLOG1"
+
+struct rr_state {
+	int replay;
+	int ndev;
+	const char * path;
+	pthread_mutex_t lock;	/* Held through every section */
+
+	/* Recording */
+	FILE * out;
+
+	/* Replaying */
+	unsigned char * log;
+	size_t len;
+	size_t pos;		/* Next record */
+	unsigned long nrec;	/* Records consumed so far */
+	int diverged;
+	pthread_cond_t * turn;	/* One per device */
+};
+
+static const char * rr_kind_name[] = {"step of device", "pid", "frame"};
+
+static void put_record(struct rr_state * rr, int kind, unsigned long v) {
+	uint64_t x = ((uint64_t)v << 2) | kind;
+	while (x >= 0x80) {
+		putc_unlocked((x & 0x7f) | 0x80, rr->out);
+		x >>= 7;
+	}
+	putc_unlocked(x, rr->out);
+}
+
+/* Decode the next record without consuming it. Returns its length, 0
+ * at the end of the log */
+static int peek_record(struct rr_state * rr, int * kind, unsigned long * v) {
+	uint64_t x = 0;
+	size_t p = rr->pos;
+	int shift = 0;
+	do {
+		if (p >= rr->len || shift > 63) {
+			return 0;
+		}
+		x |= (uint64_t)(rr->log[p] & 0x7f) << shift;
+		shift += 7;
+	} while (rr->log[p++] & 0x80);
+	*kind = x & 3;
+	*v = x >> 2;
+	return p - rr->pos;
+}
+
+static void diverge(struct rr_state * rr, const char * fmt, ...) {
+	va_list ap;
+	int dev;
+	if (rr->diverged) {
+		return;
+	}
+	fprintf(stderr, "Replay of %s diverged at record %lu: ", rr->path,
+		rr->nrec);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	rr->diverged = 1;
+	for (dev = 0; dev < rr->ndev; dev++) {
+		pthread_cond_broadcast(&rr->turn[dev]);
+	}
+}
+
+void rr_enter(int dev) {
+	struct rr_state * rr = cur_ctx->rr;
+	unsigned long v;
+	int kind, n;
+
+	if (rr == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&rr->lock);
+	if (!rr->replay) {
+		put_record(rr, RR_STEP, dev);
+		return;
+	}
+	while (!rr->diverged) {
+		if ((n = peek_record(rr, &kind, &v)) == 0) {
+			diverge(rr, "device %d stepped past the end of the log",
+				dev);
+		}else if (kind != RR_STEP || v >= (unsigned long)rr->ndev) {
+			diverge(rr, "%s %lu where a step was expected",
+				rr_kind_name[kind], v);
+		}else if (v == (unsigned long)dev) {
+			rr->pos += n;
+			rr->nrec++;
+			break;
+		}else{
+			pthread_cond_wait(&rr->turn[dev], &rr->lock);
+		}
+	}
+}
+
+void rr_exit(void) {
+	struct rr_state * rr = cur_ctx->rr;
+	unsigned long v;
+	int kind;
+
+	if (rr == NULL) {
+		return;
+	}
+	if (rr->replay && !rr->diverged && peek_record(rr, &kind, &v) > 0) {
+		if (kind != RR_STEP) {
+			diverge(rr, "step ended before its %s %lu",
+				rr_kind_name[kind], v);
+		}else if (v < (unsigned long)rr->ndev) {
+			pthread_cond_signal(&rr->turn[v]);
+		}
+	}
+	pthread_mutex_unlock(&rr->lock);
+}
+
+void rr_value(enum rr_kind_t kind, unsigned long value) {
+	struct rr_state * rr = cur_ctx->rr;
+	unsigned long v;
+	int k, n;
+
+	if (rr == NULL) {
+		return;
+	}
+	if (!rr->replay) {
+		put_record(rr, kind, value);
+		return;
+	}
+	if (rr->diverged) {
+		return;
+	}
+	if ((n = peek_record(rr, &k, &v)) == 0 || k != (int)kind ||
+	    v != value) {
+		diverge(rr, "%s %lu instead of the logged %s %lu",
+			rr_kind_name[kind], value, n ? rr_kind_name[k] : "end",
+			n ? v : 0);
+		return;
+	}
+	rr->pos += n;
+	rr->nrec++;
+}
+
+static struct rr_state * rr_create(struct os_ctx * ctx, const char * path,
+				   int replay) {
+	struct rr_state * rr = calloc(1, sizeof(struct rr_state));
+	rr->replay = replay;
+	rr->ndev = ctx->num_cpus + 1;
+	rr->path = path;
+	pthread_mutex_init(&rr->lock, NULL);
+	return rr;
+}
+
+int rr_record(struct os_ctx * ctx, const char * path) {
+	struct rr_state * rr = rr_create(ctx, path, 0);
+	if ((rr->out = fopen(path, "wb")) == NULL) {
+		printf("Cannot create replay log %s\n", path);
+		free(rr);
+		return -1;
+	}
+	fwrite(RR_MAGIC, 1, strlen(RR_MAGIC), rr->out);
+	put_record(rr, RR_STEP, rr->ndev);
+	ctx->rr = rr;
+	return 0;
+}
+
+int rr_replay(struct os_ctx * ctx, const char * path) {
+	struct rr_state * rr = rr_create(ctx, path, 1);
+	unsigned long ndev;
+	FILE * in;
+	long size;
+	int kind, n, dev;
+
+	if ((in = fopen(path, "rb")) == NULL) {
+		printf("Cannot open replay log %s\n", path);
+		free(rr);
+		return -1;
+	}
+	fseek(in, 0, SEEK_END);
+	size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	rr->log = malloc(size > 0 ? size : 1);
+	rr->len = fread(rr->log, 1, size, in);
+	fclose(in);
+
+	rr->pos = strlen(RR_MAGIC);
+	if (rr->len < rr->pos || memcmp(rr->log, RR_MAGIC, rr->pos) != 0 ||
+	    (n = peek_record(rr, &kind, &ndev)) == 0 || kind != RR_STEP) {
+		printf("%s is not a replay log\n", path);
+		free(rr->log);
+		free(rr);
+		return -1;
+	}
+	if (ndev != (unsigned long)rr->ndev) {
+		printf("%s was recorded with %lu CPUs, not %d\n", path,
+		       ndev - 1, ctx->num_cpus);
+		free(rr->log);
+		free(rr);
+		return -1;
+	}
+	rr->pos += n;
+	rr->turn = malloc(rr->ndev * sizeof(pthread_cond_t));
+	for (dev = 0; dev < rr->ndev; dev++) {
+		pthread_cond_init(&rr->turn[dev], NULL);
+	}
+	ctx->rr = rr;
+	return 0;
+}
+
+int rr_finish(struct os_ctx * ctx) {
+	struct rr_state * rr = ctx->rr;
+	int ret = 0;
+	int dev;
+
+	if (!rr->replay) {
+		fclose(rr->out);
+	}else{
+		if (rr->pos < rr->len) {
+			diverge(rr, "the run ended before the log");
+		}
+		ret = rr->diverged ? -1 : 0;
+		for (dev = 0; dev < rr->ndev; dev++) {
+			pthread_cond_destroy(&rr->turn[dev]);
+		}
+		free(rr->turn);
+		free(rr->log);
+	}
+	pthread_mutex_destroy(&rr->lock);
+	free(rr);
+	ctx->rr = NULL;
+	return ret;
+}
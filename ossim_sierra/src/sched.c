@@ -1,133 +1,594 @@
 #include "queue.h"
 #include "sched.h"
+#include "os-ctx.h"
+#include "replay.h"
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
-static struct queue_t ready_queue;
-static struct queue_t run_queue;
-static pthread_mutex_t queue_lock;
+#include <string.h>
+#include <threads.h>
+
+__thread int cur_cpu = -1;
+
+/* Fewest buckets of the table of live processes, which has at least as
+ * many as the instance loads processes, and fewest entries of a name */
+#define LIVE_MIN_BUCKETS 16
+#define LIVE_MIN_ENTS 4
 
-static struct queue_t running_list;
 #ifdef MLQ_SCHED
-struct queue_t mlq_ready_queue[MAX_PRIO];
-static int slot[MAX_PRIO];
+/* The MLQ levels live in run queues (struct mlq_rq): a single one
+ * shared by all CPUs, or with -q one per CPU. A CPU then takes and puts
+ * back processes on its own run queue; new arrivals go to the run queue
+ * with the fewest processes. A CPU that finds nothing to run steals
+ * from the most loaded of SCHED_SAMPLES peers picked at random, taking
+ * from its lowest priority level, and every SCHED_BALANCE_INTERVAL
+ * dispatches it pulls from whichever of SCHED_SAMPLES random peers has
+ * the highest level, if that beats its own, so that priorities are
+ * honoured across CPUs, if not strictly. Sampling keeps the cost of a
+ * dispatch the same however many CPUs there are; only a CPU that found
+ * every sampled peer empty walks them all, as it has nothing else to
+ * do. The seed is per run queue, so -s runs are repeatable.
+ *
+ * Run queues take no lock. Every level is a lock-free ring (queue.c),
+ * the slots left to a level are an atomic counter, and the nonempty and
+ * has_slot bitmaps mirror, one bit per level, whether the ring holds a
+ * process and whether slot_usage[prio] is above zero. A level can be
+ * picked when both bits are set, so the first candidate is a
+ * find-first-set over PRIO_WORDS words. Racing CPUs can leave a
+ * nonempty bit set on an empty ring; a pop that comes back empty clears
+ * it again, and a push always sets it after the process is in, so a
+ * queued process never goes unseen. With a single host thread (-s)
+ * every decision is the same as under a lock.
+ *
+ * Killing a queued process (mlq_unqueue()) is O(1) as well: a ring
+ * cannot give up a cell from its middle, so the process is only marked
+ * as gone and counted in dead[] of its level until a pop comes across
+ * it and drops it. Whoever moves the queued state of a process on from
+ * RQ_QUEUED owns it, so a process is either killed or dispatched, never
+ * both. A killed one is then held by both its killer and its ring, and
+ * whichever of them lets go of it last frees it (let_go()).
+ *
+ * A round ends as soon as no queued process has slots left, rather
+ * than once every level has used up its slots: levels without
+ * processes give up the rest of their slots, so a CPU is never left
+ * idle while something is queued. Levels that stay busy still get
+ * slot[] dispatches per round each. Racing refills can hand out a few
+ * extra slots, never fewer. */
+
+#define SCHED_BALANCE_INTERVAL 4
+#define SCHED_SAMPLES 2
+
+/* Processes get_mlq_proc() sets aside at most in one call as the CPU
+ * is not in their affinity mask */
+#define MLQ_SKIP_MAX 32
+
+static inline uint64_t level_bit(int prio) {
+    return (uint64_t)1 << (prio % 64);
+}
+
+/* The bitmaps are hints, relaxed order is enough. Skip the write when
+ * the bit already reads right, to keep the line shared between CPUs */
+static inline void set_level(_Atomic uint64_t *map, int prio) {
+    _Atomic uint64_t *w = &map[prio / 64];
+    if (!(atomic_load_explicit(w, memory_order_relaxed) & level_bit(prio)))
+        atomic_fetch_or_explicit(w, level_bit(prio), memory_order_relaxed);
+}
+
+static inline void clear_level(_Atomic uint64_t *map, int prio) {
+    _Atomic uint64_t *w = &map[prio / 64];
+    if (atomic_load_explicit(w, memory_order_relaxed) & level_bit(prio))
+        atomic_fetch_and_explicit(w, ~level_bit(prio), memory_order_relaxed);
+}
+
+/* Highest priority level set in [map], -1 if none */
+static inline int first_level(_Atomic uint64_t *map) {
+    int w;
+    for (w = 0; w < PRIO_WORDS; w++) {
+        uint64_t m = atomic_load_explicit(&map[w], memory_order_relaxed);
+        if (m != 0)
+            return w * 64 + __builtin_ctzll(m);
+    }
+    return -1;
+}
+
+/* Lowest priority level set in [map], -1 if none */
+static inline int last_level(_Atomic uint64_t *map) {
+    int w;
+    for (w = PRIO_WORDS - 1; w >= 0; w--) {
+        uint64_t m = atomic_load_explicit(&map[w], memory_order_relaxed);
+        if (m != 0)
+            return w * 64 + 63 - __builtin_clzll(m);
+    }
+    return -1;
+}
+
+/* Highest priority level that is both non-empty and has slots left, -1
+ * if there is none */
+static inline int first_ready_level(struct mlq_rq *rq) {
+    int w;
+    for (w = 0; w < PRIO_WORDS; w++) {
+        uint64_t ready =
+            atomic_load_explicit(&rq->nonempty[w], memory_order_relaxed) &
+            atomic_load_explicit(&rq->has_slot[w], memory_order_relaxed);
+        if (ready != 0)
+            return w * 64 + __builtin_ctzll(ready);
+    }
+    return -1;
+}
+
+/* Start a new round: give every level its configured slots again */
+static void refill_slots(struct sched_state *sched, struct mlq_rq *rq) {
+    int i;
+    for (i = 0; i < MAX_PRIO; i++) {
+        atomic_store_explicit(&rq->slot_usage[i], sched->slot[i],
+                              memory_order_relaxed);
+        if (sched->slot[i] > 0)
+            set_level(rq->has_slot, i);
+    }
+}
+
+/* Take one slot of level [prio]. Returns 0 when none was left */
+static int claim_slot(struct mlq_rq *rq, int prio) {
+    int left = atomic_load_explicit(&rq->slot_usage[prio],
+                                    memory_order_relaxed);
+    do {
+        if (left <= 0) {
+            clear_level(rq->has_slot, prio);
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(
+        &rq->slot_usage[prio], &left, left - 1, memory_order_relaxed,
+        memory_order_relaxed));
+    if (left == 1)
+        clear_level(rq->has_slot, prio);
+    return 1;
+}
+
+static void return_slot(struct mlq_rq *rq, int prio) {
+    atomic_fetch_add_explicit(&rq->slot_usage[prio], 1, memory_order_relaxed);
+    set_level(rq->has_slot, prio);
+}
+
+/* Processes queued at level [prio] of [rq], killed ones left out */
+static inline int level_size(struct mlq_rq *rq, int prio) {
+    return ring_size(&rq->mlq_ready_queue[prio]) -
+           atomic_load_explicit(&rq->dead[prio], memory_order_relaxed);
+}
 
-static int current_prio = 0;        // priority of the current processing waiting queue
-// static int current_slot_usage = 0;  // number of used slot of current processing waiting queue
-static int slot_usage[MAX_PRIO];
+/* Called once level [prio] was seen empty. A push racing with the
+ * clear sets the bit again itself, after its process is in */
+static void level_drained(struct mlq_rq *rq, int prio) {
+    clear_level(rq->nonempty, prio);
+    if (level_size(rq, prio) > 0)
+        set_level(rq->nonempty, prio);
+}
+
+/* Slot [proc] was queued at its current priority from: put back or
+ * added, or moved there while queued. Time on a CPU does not count */
+static inline uint64_t queued_since(const struct pcb_t *proc) {
+    return proc->ready_since > proc->level_since ? proc->ready_since
+                                                 : proc->level_since;
+}
+
+/* With MLFQ aging, bring age_due of the level of [proc], just queued
+ * on [rq], down to when it may be aged */
+static void note_age_due(struct mlq_rq *rq, struct pcb_t *proc) {
+    struct sched_state *sched = &cur_ctx->sched;
+    _Atomic uint64_t *due = &rq->age_due[proc->prio];
+    uint64_t at, cur;
+    if (sched->mlfq_age <= 0 || proc->prio <= proc->base_prio)
+        return;
+    at = queued_since(proc) + sched->mlfq_age;
+    cur = atomic_load_explicit(due, memory_order_relaxed);
+    while (at < cur &&
+           !atomic_compare_exchange_weak_explicit(due, &cur, at,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+/* Only while no CPU is running, e.g. at start or restore, with no
+ * killed process on the rings */
+void sched_sync_rq(struct mlq_rq *rq) {
+    int i, j, nr = 0;
+    for (i = 0; i < PRIO_WORDS; i++) {
+        atomic_store(&rq->nonempty[i], 0);
+        atomic_store(&rq->has_slot[i], 0);
+    }
+    for (i = 0; i < MAX_PRIO; i++) {
+        int size = ring_size(&rq->mlq_ready_queue[i]);
+        atomic_store(&rq->age_due[i], SLOT_NEVER);
+        for (j = 0; j < size; j++) {
+            struct pcb_t *proc = ring_peek(&rq->mlq_ready_queue[i], j);
+            proc->rq = rq - cur_ctx->sched.rq;
+            atomic_store(&proc->queued, RQ_QUEUED);
+            note_age_due(rq, proc);
+        }
+        atomic_store(&rq->dead[i], 0);
+        if (size > 0)
+            set_level(rq->nonempty, i);
+        if (atomic_load(&rq->slot_usage[i]) > 0)
+            set_level(rq->has_slot, i);
+        nr += size;
+    }
+    atomic_store(&rq->nr, nr);
+}
+
+/* Queue [proc] on [rq]. Its handle is set before it can be popped */
+static void rq_add(struct mlq_rq *rq, struct pcb_t *proc) {
+    proc->rq = rq - cur_ctx->sched.rq;
+    atomic_store_explicit(&proc->queued, RQ_QUEUED, memory_order_release);
+    ring_push(&rq->mlq_ready_queue[proc->prio], proc);
+    atomic_fetch_add_explicit(&rq->nr, 1, memory_order_relaxed);
+    set_level(rq->nonempty, proc->prio);
+    note_age_due(rq, proc);
+}
+
+/* The ring or the killer of [proc], killed on a ring, is done with it.
+ * The second one frees it */
+static void let_go(struct pcb_t *proc) {
+    if (atomic_fetch_add_explicit(&proc->queued, 1, memory_order_acq_rel) ==
+        RQ_ORPHAN)
+        free(proc);
+}
+
+/* Pop from level [prio] of [rq], NULL if it turned out empty. Killed
+ * processes met on the way are dropped */
+static struct pcb_t *rq_take(struct mlq_rq *rq, int prio) {
+    struct pcb_t *proc;
+    int state;
+    while ((proc = ring_pop(&rq->mlq_ready_queue[prio])) != NULL) {
+        state = RQ_QUEUED;
+        if (atomic_compare_exchange_strong_explicit(
+                &proc->queued, &state, RQ_NONE, memory_order_acq_rel,
+                memory_order_acquire))
+            break;
+        atomic_fetch_sub_explicit(&rq->dead[prio], 1, memory_order_relaxed);
+        let_go(proc);
+    }
+    if (proc != NULL)
+        atomic_fetch_sub_explicit(&rq->nr, 1, memory_order_relaxed);
+    if (level_size(rq, prio) == 0)
+        level_drained(rq, prio);
+    return proc;
+}
+
+static inline int rq_levels_empty(struct mlq_rq *rq) {
+    return first_level(rq->nonempty) < 0;
+}
+
+/* Run queue of the CPU the calling thread is stepping, NULL when it is
+ * not stepping a CPU (the loader) */
+static struct mlq_rq *local_rq(struct sched_state *sched) {
+    if (sched->nr_rq == 1)
+        return &sched->rq[0];
+    if (cur_cpu >= 0 && cur_cpu < sched->nr_rq)
+        return &sched->rq[cur_cpu];
+    return NULL;
+}
+
+/* O(1) a process, from any thread. A killed process stays on its ring
+ * until a pop drops it, see rq_take(). Killers decrement nr and count
+ * it dead only once the process is theirs, so the counts may lag
+ * behind the rings but never hide a queued process */
+static int mlq_unqueue(struct pcb_t **procs, int n) {
+    int i, k = 0;
+    for (i = 0; i < n; i++) {
+        struct pcb_t *proc = procs[i];
+        struct mlq_rq *rq;
+        int state = RQ_QUEUED;
+        if (!atomic_compare_exchange_strong(&proc->queued, &state, RQ_KILLED))
+            continue;   /* On a CPU, or between two rings */
+        rq = &cur_ctx->sched.rq[proc->rq];
+        atomic_fetch_add_explicit(&rq->dead[proc->prio], 1,
+                                  memory_order_relaxed);
+        atomic_fetch_sub_explicit(&rq->nr, 1, memory_order_relaxed);
+        if (level_size(rq, proc->prio) == 0)
+            level_drained(rq, proc->prio);
+        procs[k++] = proc;
+    }
+    return k;
+}
+#endif
+
+/* Policies a config file can name, see struct sched_ops. MLQ and FIFO
+ * are below, CFS and EDF in sched_cfs.c and sched_edf.c */
+const struct sched_ops *sched_find(const char *name) {
+    static const struct sched_ops *const all[] = {
+#ifdef MLQ_SCHED
+        &mlq_sched_ops,
+        &mlfq_sched_ops,
 #endif
+        &fifo_sched_ops,
+        &cfs_sched_ops,
+        &edf_sched_ops,
+    };
+    size_t i;
+    for (i = 0; i < sizeof(all) / sizeof(all[0]); i++)
+        if (strcmp(all[i]->name, name) == 0)
+            return all[i];
+    return NULL;
+}
 
 /**
  * @brief Check if all scheduling queues are empty.
  *
- * This function checks whether all ready and run queues (and MLQ queues if enabled)
- * are empty, indicating that there are no processes left to schedule.
+ * This function asks the policy of the instance whether any process is
+ * left to schedule.
  *
  * @return 1 if all queues are empty, 0 otherwise.
  */
 int queue_empty(void) {
-#ifdef MLQ_SCHED
-    unsigned long prio;
-    for (prio = 0; prio < MAX_PRIO; prio++) {
-        if (!empty(&mlq_ready_queue[prio]))
-            return -1;
-    }
-#endif
-    return (empty(&ready_queue) && empty(&run_queue));
+    return cur_ctx->sched_ops->empty();
 }
 
 /**
  * @brief Initialize the scheduler and its queues.
  *
- * This function initializes all scheduling queues and related variables,
- * including mutexes and slot counters for MLQ scheduling if enabled.
+ * This function initializes the queues shared by every policy and their
+ * mutex, then lets the policy of the instance set up its own.
  */
 void init_scheduler(void) {
-#ifdef MLQ_SCHED
-    int i;
-    for (i = 0; i < MAX_PRIO; i++) {
-        mlq_ready_queue[i].size = 0;
-// Cấu hình ban đầu: Cấp cao hơn có nhiều slot hơn.
-        slot[i] = MAX_PRIO - i;
-// Khởi tạo slot_usage ban đầu từ cấu hình.
-        slot_usage[i] = slot[i];
+    struct sched_state *sched = &cur_ctx->sched;
+    unsigned int buckets = LIVE_MIN_BUCKETS;
+    while (buckets < (unsigned int)cur_ctx->num_processes)
+        buckets *= 2;
+    cur_ctx->live = calloc(buckets, sizeof(struct live_name *));
+    cur_ctx->live_mask = buckets - 1;
+    heap_init(&sched->ready_queue);
+    heap_init(&sched->run_queue);
+    heap_init(&sched->edf_heap);
+    queue_init(&sched->running_list);
+    sched->cfs_tree = RB_ROOT_INIT;
+    sched->min_vruntime = 0;
+    pthread_mutex_init(&sched->queue_lock, NULL);
+    pthread_mutex_init(&sched->quantum_lock, NULL);
+    for (int i = 0; i < MAX_PRIO; i++) {
+        sched->quantum[i] = cur_ctx->quantum[i] ? cur_ctx->quantum[i]
+                                                : cur_ctx->time_slot;
+        memset(&sched->qwin[i], 0, sizeof(sched->qwin[i]));
     }
-#endif
-    ready_queue.size = 0;
-    run_queue.size = 0;
-    pthread_mutex_init(&queue_lock, NULL);
+    if (cur_ctx->sched_ops->init != NULL)
+        cur_ctx->sched_ops->init();
 }
 
-///////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////// MLQ SCHED //////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////
+void finish_scheduler(void) {
+    struct sched_state *sched = &cur_ctx->sched;
+    unsigned int i;
+    if (cur_ctx->sched_ops->finish != NULL)
+        cur_ctx->sched_ops->finish();
+    heap_free(&sched->ready_queue);
+    heap_free(&sched->run_queue);
+    heap_free(&sched->edf_heap);
+    queue_free(&sched->running_list);
+    for (i = 0; i <= cur_ctx->live_mask; i++) {
+        struct live_name *name = cur_ctx->live[i];
+        while (name != NULL) {
+            struct live_name *next = name->next;
+            free(name->ent);
+            free(name);
+            name = next;
+        }
+    }
+    free(cur_ctx->live);
+    cur_ctx->live = NULL;
+}
 
-#ifdef MLQ_SCHED
+/* Bucket of the table of live processes for name [path] (FNV-1a) */
+static struct live_name **live_bucket(struct os_ctx *ctx, const char *path) {
+    uint32_t h = 2166136261u;
+    while (*path != '\0')
+        h = (h ^ (unsigned char)*path++) * 16777619u;
+    return &ctx->live[h & ctx->live_mask];
+}
 
-/**
- * @brief Get the next process from the current MLQ ready queues.
- *
- * This function selects and removes the next process to run from the multi-level
- * queue (MLQ) ready queues, following the MLQ round-robin policy and slot usage.
- *
- * @return Pointer to the selected process, or NULL if no process is available.
- */
-struct pcb_t * get_mlq_proc(void) {    
-    pthread_mutex_lock(&queue_lock);
+/* The live processes named [path], NULL if none ever was. Under
+ * live_lock */
+static struct live_name *live_find(struct os_ctx *ctx, const char *path) {
+    struct live_name *name = *live_bucket(ctx, path);
+    while (name != NULL && strcmp(name->path, path) != 0)
+        name = name->next;
+    return name;
+}
 
-    // Kiểm tra tất cả slot_usage có đều = 0, nếu vậy reset lại slot_usage từ mảng slot.
-    bool all_zero = true;
-    for (int i = 0; i < MAX_PRIO; i++) {
-        if (slot_usage[i] > 0) {
-            all_zero = false;
-            break;
-        }
+void sched_add_live(struct pcb_t *proc) {
+    struct os_ctx *ctx = cur_ctx;
+    struct live_name *name;
+    pthread_mutex_lock(&ctx->live_lock);
+    if ((name = live_find(ctx, proc->path)) == NULL) {
+        struct live_name **bucket = live_bucket(ctx, proc->path);
+        name = calloc(1, sizeof(struct live_name));
+        strncpy(name->path, proc->path, sizeof(name->path) - 1);
+        name->next = *bucket;
+        *bucket = name;
     }
-    if (all_zero) {
-        for (int i = 0; i < MAX_PRIO; i++) {
-            slot_usage[i] = slot[i];
+    if (name->nr == name->cap) {
+        name->cap = name->cap ? name->cap * 2 : LIVE_MIN_ENTS;
+        name->ent = realloc(name->ent, name->cap * sizeof(struct live_ent));
+    }
+    name->ent[name->nr].pid = proc->pid;
+    name->ent[name->nr].proc = proc;
+    proc->live = name;
+    proc->live_idx = name->nr++;
+    pthread_mutex_unlock(&ctx->live_lock);
+}
+
+/* Take [proc] out of the table of live processes. Under live_lock */
+static void live_del(struct pcb_t *proc) {
+    struct live_name *name = proc->live;
+    int i, n = 0;
+    if (name == NULL)
+        return;
+    name->ent[proc->live_idx].proc = NULL;
+    proc->live = NULL;
+    if (++name->holes * 2 <= name->nr)
+        return;
+    for (i = 0; i < name->nr; i++) {
+        if (name->ent[i].proc != NULL) {
+            name->ent[n] = name->ent[i];
+            name->ent[n].proc->live_idx = n;
+            n++;
         }
     }
+    name->nr = n;
+    name->holes = 0;
+}
 
-    struct pcb_t * proc = NULL;
-    // Duyệt qua các mức ưu tiên để tìm hàng đợi có slot còn và không rỗng
-    for (int pr = 0; pr < MAX_PRIO; pr++) {
-        if (slot_usage[pr] > 0 && !empty(&mlq_ready_queue[pr])) {
-            proc = dequeue(&mlq_ready_queue[pr]);
-            slot_usage[pr]--;
-            pthread_mutex_unlock(&queue_lock);
-            return proc;
+static int by_pid(const void *a, const void *b) {
+    uint32_t x = (*(struct pcb_t *const *)a)->pid;
+    uint32_t y = (*(struct pcb_t *const *)b)->pid;
+    return (x > y) - (x < y);
+}
+
+/* The table of live processes hands over those of the name, in the
+ * order they were added, without looking into any PCB, and the policy
+ * takes them off its queues at once through the handles it keeps in
+ * them. The cost depends neither on how many levels or queues there
+ * are nor on how many processes of other names live. The order added
+ * is the pid order but after a checkpoint restore */
+void sched_remove_procs(const char *path, void (*drop)(struct pcb_t *)) {
+    struct os_ctx *ctx = cur_ctx;
+    struct live_name *name;
+    struct pcb_t **batch;
+    uint32_t last = 0;
+    int n = 0, sorted = 1, i;
+    pthread_mutex_lock(&ctx->live_lock);
+    if ((name = live_find(ctx, path)) == NULL ||
+        name->nr == name->holes) {
+        pthread_mutex_unlock(&ctx->live_lock);
+        return;
+    }
+    batch = malloc((name->nr - name->holes) * sizeof(struct pcb_t *));
+    for (i = 0; i < name->nr; i++) {
+        if (name->ent[i].proc != NULL) {
+            sorted &= name->ent[i].pid > last;
+            last = name->ent[i].pid;
+            batch[n++] = name->ent[i].proc;
         }
     }
-    pthread_mutex_unlock(&queue_lock);
-    return NULL;
+    n = ctx->sched_ops->unqueue(batch, n);
+    if (!sorted)
+        qsort(batch, n, sizeof(struct pcb_t *), by_pid);
+    for (i = 0; i < n; i++) {
+        live_del(batch[i]);
+        drop(batch[i]);
+    }
+    pthread_mutex_unlock(&ctx->live_lock);
+    for (i = 0; i < n; i++) {
+#ifdef MLQ_SCHED
+        /* Still on a ring */
+        if (atomic_load(&batch[i]->queued) != RQ_NONE) {
+            let_go(batch[i]);
+            continue;
+        }
+#endif
+        free(batch[i]);
+    }
+    free(batch);
 }
 
-/**
- * @brief Put a process back into its MLQ ready queue.
- *
- * This function enqueues a process into the MLQ ready queue corresponding to its priority.
- *
- * @param proc Pointer to the process to enqueue.
- */
-void put_mlq_proc(struct pcb_t * proc) {
-    if(proc == NULL) return;
-    pthread_mutex_lock(&queue_lock);
-        enqueue(&mlq_ready_queue[proc->prio], proc);
-    pthread_mutex_unlock(&queue_lock);
+void sched_tick(struct pcb_t *proc) {
+    if (cur_ctx->sched_ops->tick != NULL)
+        cur_ctx->sched_ops->tick(proc);
+}
+
+void sched_exit(struct pcb_t *proc) {
+    if (cur_ctx->sched_ops->on_exit != NULL)
+        cur_ctx->sched_ops->on_exit(proc);
+    pthread_mutex_lock(&cur_ctx->live_lock);
+    live_del(proc);
+    pthread_mutex_unlock(&cur_ctx->live_lock);
+}
+
+void sched_expire(struct pcb_t *proc) {
+    if (cur_ctx->sched_ops->expire != NULL)
+        cur_ctx->sched_ops->expire(proc);
+}
+
+static int quantum_level(const struct pcb_t *proc) {
+    uint32_t prio = proc_prio(proc);
+    return prio < MAX_PRIO ? (int)prio : MAX_PRIO - 1;
+}
+
+int sched_quantum(const struct pcb_t *proc) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int q;
+    if (!cur_ctx->adaptive_quantum)
+        return sched->quantum[quantum_level(proc)];
+    pthread_mutex_lock(&sched->quantum_lock);
+    q = sched->quantum[quantum_level(proc)];
+    pthread_mutex_unlock(&sched->quantum_lock);
+    return q;
+}
+
+/* Every QUANTUM_WINDOW quanta ended at a level, its quantum shrinks by
+ * a quarter if more than twice as many processes as there are CPUs
+ * waited there on average, so that they take turns sooner. It grows by
+ * a quarter if nothing waited there and most quanta were used up, since
+ * switching then only costs dispatches. It stays between 1 and QUANTUM_MAX_SCALE
+ * times the configured value */
+#define QUANTUM_WINDOW 8
+#define QUANTUM_MAX_SCALE 8
+
+void sched_quantum_end(const struct pcb_t *proc, int expired) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int level = quantum_level(proc);
+    struct quantum_window *w = &sched->qwin[level];
+    int base, step;
+    if (!cur_ctx->adaptive_quantum || cur_ctx->sched_ops->depth == NULL)
+        return;
+    pthread_mutex_lock(&sched->quantum_lock);
+    w->ends++;
+    w->expired += expired;
+    w->depth += cur_ctx->sched_ops->depth(level);
+    if (w->ends == QUANTUM_WINDOW) {
+        int *q = &sched->quantum[level];
+        base = cur_ctx->quantum[level] ? cur_ctx->quantum[level]
+                                       : cur_ctx->time_slot;
+        step = *q / 4 > 0 ? *q / 4 : 1;
+        if (w->depth > 2 * cur_ctx->num_cpus * QUANTUM_WINDOW)
+            *q = *q - step > 1 ? *q - step : 1;
+        else if (w->depth == 0 && 2 * w->expired > w->ends)
+            *q = *q + step < base * QUANTUM_MAX_SCALE ? *q + step
+                                                     : base * QUANTUM_MAX_SCALE;
+        memset(w, 0, sizeof(*w));
+    }
+    pthread_mutex_unlock(&sched->quantum_lock);
+}
+
+void sched_place(int cpu) {
+#ifdef MLQ_SCHED
+    struct sched_state *sched = &cur_ctx->sched;
+    if ((cur_ctx->sched_ops == &mlq_sched_ops ||
+         cur_ctx->sched_ops == &mlfq_sched_ops) && cpu < sched->nr_rq)
+        sched->place_rq = cpu;
+#else
+    (void)cpu;
+#endif
+}
+
+int sched_keep(struct pcb_t *proc) {
+    if (cur_ctx->warm_tol < 0 || cur_ctx->sched_ops->keep == NULL ||
+        !cur_ctx->sched_ops->keep(proc))
+        return 0;
+    /* Handed out again, as far as replay is concerned */
+    rr_value(RR_PROC, proc->pid);
+    return 1;
 }
 
 /**
  * @brief Get the next process to run.
  *
- * This function selects and removes the next process to run from the ready or run queues,
- * or from the MLQ ready queues if MLQ scheduling is enabled.
+ * This function selects and removes the next process to run, as the
+ * policy of the instance decides.
  *
  * @return Pointer to the selected process, or NULL if no process is available.
  */
 struct pcb_t * get_proc(void) {
-    return get_mlq_proc();
+    struct pcb_t * proc = cur_ctx->sched_ops->pick_next();
+    rr_value(RR_PROC, proc != NULL ? proc->pid : 0);
+    return proc;
 }
 
 /**
@@ -138,58 +599,580 @@ struct pcb_t * get_proc(void) {
  * @param proc Pointer to the process to put back.
  */
 void put_proc(struct pcb_t * proc) {
+    struct sched_state *sched = &cur_ctx->sched;
     if(proc == NULL) return;
-    proc->ready_queue = &ready_queue;
-    proc->mlq_ready_queue = mlq_ready_queue;
-    proc->running_list = &running_list;
-    put_mlq_proc(proc);
+    proc->ready_queue = &sched->ready_queue;
+    proc->running_list = &sched->running_list;
+    proc->ready_since = current_time();
+    cur_ctx->sched_ops->requeue(proc);
 }
 
 /**
  * @brief Add a new process to the scheduler's queue.
  *
- * This function adds a new process to the appropriate ready queue and updates bookkeeping lists.
+ * This function adds a new process to the appropriate ready queue, updates bookkeeping lists and wakes up a parked CPU that may run it.
  *
  * @param proc Pointer to the process to add.
  */
 void add_proc(struct pcb_t * proc) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int last_cpu;
+    uint64_t affinity;
     if(proc == NULL) return;
-    put_proc(proc);
+    proc->ready_queue = &sched->ready_queue;
+    proc->running_list = &sched->running_list;
+    proc->ready_since = current_time();
+    sched_add_live(proc);
+    /* Once queued, it is no longer ours to read */
+    last_cpu = proc->last_cpu;
+    affinity = proc->affinity;
+    cur_ctx->sched_ops->enqueue(proc);
+    wake_idle_cpu(last_cpu, affinity);
 }
-#else
+
 ///////////////////////////////////////////////////////////////////////////////////////
-//////////////////////////// NORMAL SCHED /////////////////////////////////////////////
+////////////////////////////// MLQ SCHED //////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////
 
-struct pcb_t * get_proc(void) {
-    struct pcb_t * proc = NULL;
-    pthread_mutex_lock(&queue_lock);
-    if (!empty(&ready_queue))
-        proc = dequeue(&ready_queue);
-    else if (!empty(&run_queue))
-        proc = dequeue(&run_queue);
-    pthread_mutex_unlock(&queue_lock);
+#ifdef MLQ_SCHED
+
+static void init_mlq(void) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int i, r, per_rq;
+    for (i = 0; i < MAX_PRIO; i++) {
+// Cấu hình ban đầu: Cấp cao hơn có nhiều slot hơn.
+        sched->slot[i] = MAX_PRIO - i;
+    }
+    sched->nr_rq = cur_ctx->percpu_rq ? cur_ctx->num_cpus : 1;
+    /* Cells for an even share of the processes at any one level. A run
+     * queue left with more by stealing spills the rest over (queue.c) */
+    per_rq = (cur_ctx->num_processes + sched->nr_rq - 1) / sched->nr_rq;
+    sched->rq = aligned_alloc(_Alignof(struct mlq_rq),
+                              sched->nr_rq * sizeof(struct mlq_rq));
+    sched->next_rq = 0;
+    sched->place_rq = -1;
+    for (r = 0; r < sched->nr_rq; r++) {
+        struct mlq_rq *rq = &sched->rq[r];
+        rq->picks = 0;
+        rq->seed = r + 1;
+        for (i = 0; i < MAX_PRIO; i++) {
+            ring_init(&rq->mlq_ready_queue[i], per_rq);
+// Khởi tạo slot_usage ban đầu từ cấu hình.
+            atomic_init(&rq->slot_usage[i], sched->slot[i]);
+        }
+        sched_sync_rq(rq);
+    }
+}
+
+static void finish_mlq(void) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int i, r;
+    for (r = 0; r < sched->nr_rq; r++)
+        for (i = 0; i < MAX_PRIO; i++) {
+            /* Frees the processes killed on the ring */
+            while (rq_take(&sched->rq[r], i) != NULL)
+                ;
+            ring_destroy(&sched->rq[r].mlq_ready_queue[i]);
+        }
+    free(sched->rq);
+    sched->rq = NULL;
+    sched->nr_rq = 0;
+}
+
+static int mlq_depth(int prio) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int i, n = 0;
+    for (i = 0; i < sched->nr_rq; i++)
+        n += level_size(&sched->rq[i], prio);
+    return n;
+}
+
+static int mlq_empty(void) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int i;
+    for (i = 0; i < sched->nr_rq; i++)
+        if (atomic_load(&sched->rq[i].nr) != 0)
+            return 0;
+    return 1;
+}
+
+/* A peer of [self] at random (xorshift) */
+static struct mlq_rq *random_peer(struct sched_state *sched,
+                                  struct mlq_rq *self) {
+    unsigned int x = self->seed;
+    int r;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    self->seed = x;
+    r = x % (sched->nr_rq - 1);
+    if (r >= self - sched->rq)
+        r++;
+    return &sched->rq[r];
+}
+
+/* Take a process from the most loaded of SCHED_SAMPLES random peers of
+ * [self], or of all of them if those are empty, from its lowest
+ * priority level. NULL if every peer is empty */
+static struct pcb_t *steal_proc(struct sched_state *sched,
+                                struct mlq_rq *self) {
+    struct mlq_rq *victim = NULL;
+    struct pcb_t *proc = NULL;
+    int most = 0, r, pr = -1, tries;
+    for (r = 0; r < SCHED_SAMPLES; r++) {
+        struct mlq_rq *peer = random_peer(sched, self);
+        int nr = atomic_load_explicit(&peer->nr, memory_order_relaxed);
+        if (nr > most) {
+            most = nr;
+            victim = peer;
+        }
+    }
+    for (r = 0; victim == NULL && r < sched->nr_rq; r++) {
+        int nr = atomic_load_explicit(&sched->rq[r].nr, memory_order_relaxed);
+        if (&sched->rq[r] != self && nr > most) {
+            most = nr;
+            victim = &sched->rq[r];
+        }
+    }
+    if (victim == NULL)
+        return NULL;
+    for (tries = 0; proc == NULL && tries < MAX_PRIO; tries++) {
+        if ((pr = last_level(victim->nonempty)) < 0)
+            return NULL;
+        proc = rq_take(victim, pr);
+    }
+    if (proc != NULL && !proc_allowed(proc, cur_cpu)) {
+        rq_add(victim, proc);   /* Not ours to run */
+        return NULL;
+    }
+    if (proc != NULL)
+        trace(get_proc, proc->pid, pr, 0);
     return proc;
 }
 
-void put_proc(struct pcb_t * proc) {
+/* Take the process at the highest priority level queued on
+ * SCHED_SAMPLES random peers of [self], if that level beats everything
+ * queued on [self], by more than the warm tolerance with -a */
+static struct pcb_t *pull_higher_proc(struct sched_state *sched,
+                                      struct mlq_rq *self) {
+    struct mlq_rq *victim = NULL;
+    struct pcb_t *proc;
+    int best = first_level(self->nonempty);
+    int tol = cur_ctx->warm_tol > 0 ? cur_ctx->warm_tol : 0;
+    int r, pr;
+    if (best < 0)
+        best = MAX_PRIO;
+    else
+        best -= tol;
+    for (r = 0; r < SCHED_SAMPLES; r++) {
+        struct mlq_rq *peer = random_peer(sched, self);
+        int top = first_level(peer->nonempty);
+        if (top >= 0 && top < best) {
+            best = top;
+            victim = peer;
+        }
+    }
+    if (victim == NULL || (pr = first_level(victim->nonempty)) < 0 ||
+        pr > best || (proc = rq_take(victim, pr)) == NULL)
+        return NULL;
+    if (!proc_allowed(proc, cur_cpu)) {
+        rq_add(victim, proc);
+        return NULL;
+    }
+    trace(get_proc, proc->pid, pr, 0);
+    return proc;
+}
+
+/**
+ * @brief Get the next process from the current MLQ ready queues.
+ *
+ * This function selects and removes the next process to run from the multi-level
+ * queue (MLQ) ready queues, following the MLQ round-robin policy and slot usage.
+ * With per-CPU run queues, it falls back to stealing from a peer.
+ *
+ * @return Pointer to the selected process, or NULL if no process is available.
+ */
+struct pcb_t * get_mlq_proc(void) {    
+    struct sched_state *sched = &cur_ctx->sched;
+    struct mlq_rq *rq = local_rq(sched);
+    struct pcb_t *proc = NULL;
+    struct pcb_t *skipped[MLQ_SKIP_MAX];
+    int nr_skipped = 0, stolen = 0, i;
+    int refilled = 0;
+    int pr = -1;
+
+    if (sched->nr_rq > 1 && ++rq->picks % SCHED_BALANCE_INTERVAL == 0 &&
+        (proc = pull_higher_proc(sched, rq)) != NULL)
+        return proc;
+
+    while (proc == NULL) {
+        // Mức ưu tiên cao nhất còn slot và không rỗng
+        pr = first_ready_level(rq);
+        if (pr < 0) {
+            if (refilled || rq_levels_empty(rq)) {
+                if (sched->nr_rq > 1)
+                    proc = steal_proc(sched, rq);
+                stolen = 1;
+                break;
+            }
+            // Các mức có tiến trình đều hết slot: bắt đầu vòng mới.
+            refill_slots(sched, rq);
+            refilled = 1;
+            continue;
+        }
+        if (!claim_slot(rq, pr))
+            continue;
+        if ((proc = rq_take(rq, pr)) == NULL) {
+            /* Another CPU emptied the level, or a pusher that claimed
+             * its tail has not published the cell yet: let it run */
+            return_slot(rq, pr);
+            thrd_yield();
+        } else if (!proc_allowed(proc, cur_cpu)) {
+            /* Set aside until one this CPU may run turns up */
+            return_slot(rq, pr);
+            skipped[nr_skipped++] = proc;
+            proc = NULL;
+            if (nr_skipped == MLQ_SKIP_MAX)
+                break;
+        }
+    }
+    for (i = 0; i < nr_skipped; i++)
+        rq_add(rq, skipped[i]);
+    if (proc != NULL && !stolen)
+        trace(get_proc, proc->pid, pr, 0);
+    return proc;
+}
+
+static uint64_t mlq_rank(const struct pcb_t *proc) {
+    return proc->prio;
+}
+
+/* The process at the end of its quantum keeps the CPU while nothing
+ * waits at its level on this run queue and no level more than warm_tol
+ * above it has anything, if its level has a slot left */
+static int mlq_keep(struct pcb_t *proc) {
+    struct mlq_rq *rq = local_rq(&cur_ctx->sched);
+    int best = first_level(rq->nonempty);
+    if (level_size(rq, proc->prio) > 0 ||
+        (best >= 0 && best < (int)proc->prio - cur_ctx->warm_tol))
+        return 0;
+    return claim_slot(rq, proc->prio);
+}
+
+/* Run queue [proc] goes to: the calling CPU's, or for new arrivals the
+ * one sched_place() chose or else the least loaded */
+static struct mlq_rq *put_rq(struct sched_state *sched, struct pcb_t *proc) {
+    struct mlq_rq *rq;
+    if ((rq = local_rq(sched)) == NULL && sched->place_rq >= 0) {
+        rq = &sched->rq[sched->place_rq];
+        sched->place_rq = -1;
+    } else if (rq == NULL) {
+        /* Only the loader gets here, so next_rq needs no lock */
+        int r = 0, i, least = -1;
+        for (i = 0; i < sched->nr_rq; i++) {
+            int c = (sched->next_rq + i) % sched->nr_rq;
+            int nr = atomic_load(&sched->rq[c].nr);
+            if (!proc_allowed(proc, c))
+                continue;
+            if (least < 0 || nr < least) {
+                least = nr;
+                r = c;
+            }
+        }
+        sched->next_rq = (r + 1) % sched->nr_rq;
+        rq = &sched->rq[r];
+    }
+    return rq;
+}
+
+/**
+ * @brief Put a process back into its MLQ ready queue.
+ *
+ * This function enqueues a process into the MLQ ready queue corresponding to its priority,
+ * on the run queue of the calling CPU, or on the least loaded one for new arrivals.
+ *
+ * @param proc Pointer to the process to enqueue.
+ */
+void put_mlq_proc(struct pcb_t * proc) {
     if(proc == NULL) return;
-    proc->ready_queue = &ready_queue;
-    proc->running_list = &running_list;
+    trace(put_proc, proc->pid, proc->prio, 0);
+    rq_add(put_rq(&cur_ctx->sched, proc), proc);
+}
+
+const struct sched_ops mlq_sched_ops = {
+    .name = "mlq",
+    .init = init_mlq,
+    .finish = finish_mlq,
+    .pick_next = get_mlq_proc,
+    .enqueue = put_mlq_proc,
+    .requeue = put_mlq_proc,
+    .keep = mlq_keep,
+    .rank = mlq_rank,
+    .depth = mlq_depth,
+    .empty = mlq_empty,
+    .unqueue = mlq_unqueue,
+};
+
+/* Multilevel feedback queue ("mlfq" in the config file): the MLQ above,
+ * with the priority of a process following how it behaves rather than
+ * staying where its config line put it. The feedback levels are steps
+ * of mlfq_step priorities, so that demotions tell among the MAX_PRIO
+ * of them. A process that uses up its quantum is demoted one level,
+ * mlfq_step priorities down. One that waited mlfq_age slots queued at
+ * its priority, not counting the time it ran, is aged one level up,
+ * and every mlfq_boost slots all of them are boosted back to the
+ * priority of their config line, which none is ever aged above. Aging
+ * and boosts are passes over the queues, run by the first CPU to pick
+ * once one is due; a running process catches up with a boost when its
+ * quantum ends. The slots processes spent at each priority are kept in
+ * residency[]. */
+
+/* Defaults, in priorities and quanta of time_slot slots */
+#define MLFQ_STEP 10
+#define MLFQ_AGE_QUANTA 8
+#define MLFQ_BOOST_QUANTA 64
 
-    pthread_mutex_lock(&queue_lock);
-    enqueue(&run_queue, proc);
-    pthread_mutex_unlock(&queue_lock);
+/* Passes over the queues per mlfq_age slots */
+#define MLFQ_AGE_PASSES 4
+
+/* Account the slots [proc], running or off the queues, spent at its
+ * level, and move it to [prio] */
+static void mlfq_move(struct sched_state *sched, struct pcb_t *proc,
+                      uint32_t prio) {
+    uint64_t now = current_time();
+    atomic_fetch_add(&sched->residency[proc->prio], now - proc->level_since);
+    proc->level_since = now;
+    proc->prio = prio;
 }
 
-void add_proc(struct pcb_t * proc) {
-    if(proc == NULL) return;    
-    proc->ready_queue = &ready_queue;
-    proc->running_list = &running_list;
+static void mlfq_catch_up(struct sched_state *sched, struct pcb_t *proc) {
+    unsigned int boosts = atomic_load(&sched->mlfq_boosts);
+    if (proc->boosts != boosts) {
+        proc->boosts = boosts;
+        if (proc->prio != proc->base_prio)
+            mlfq_move(sched, proc, proc->base_prio);
+    }
+}
+
+/* Take the processes of a level off its ring and push them back in the
+ * same order, aged or boosted. A boost walks every level; aging only
+ * those whose age_due has come, so that a pass costs the processes of
+ * levels holding one to age rather than all of those queued. age_due
+ * is reset before the walk, the processes pushed back set it again.
+ * Levels are walked from the top and processes only move up, so none
+ * is seen twice. The pass holds live_lock, as a process it has taken
+ * off a ring would look like one on a CPU to sched_remove_procs() and
+ * survive the kill */
+static void mlfq_pass(struct sched_state *sched, uint64_t now) {
+    int r, prio, n;
+    int boost = sched->mlfq_boost > 0 && now >= sched->mlfq_next_boost;
+    pthread_mutex_lock(&cur_ctx->live_lock);
+    if (boost) {
+        atomic_fetch_add(&sched->mlfq_boosts, 1);
+        sched->mlfq_next_boost = now + sched->mlfq_boost;
+    }
+    for (r = 0; r < sched->nr_rq; r++) {
+        struct mlq_rq *rq = &sched->rq[r];
+        for (prio = 0; prio < MAX_PRIO; prio++) {
+            struct pcb_t *proc;
+            if (!boost && atomic_load(&rq->age_due[prio]) > now)
+                continue;
+            atomic_store(&rq->age_due[prio], SLOT_NEVER);
+            for (n = level_size(rq, prio); n > 0; n--) {
+                if ((proc = rq_take(rq, prio)) == NULL)
+                    break;
+                mlfq_catch_up(sched, proc);
+                if (sched->mlfq_age > 0 && proc->prio > proc->base_prio &&
+                    now - queued_since(proc) >= (uint64_t)sched->mlfq_age) {
+                    uint32_t up = proc->prio - sched->mlfq_step;
+                    if (proc->prio < proc->base_prio + sched->mlfq_step)
+                        up = proc->base_prio;
+                    mlfq_move(sched, proc, up);
+                    atomic_fetch_add(&sched->mlfq_promotions, 1);
+                }
+                rq_add(rq, proc);
+            }
+        }
+    }
+    pthread_mutex_unlock(&cur_ctx->live_lock);
+}
+
+static uint64_t mlfq_next_pass(struct sched_state *sched, uint64_t now) {
+    uint64_t next = SLOT_NEVER;
+    if (sched->mlfq_age > 0) {
+        int step = sched->mlfq_age / MLFQ_AGE_PASSES;
+        next = now + (step > 0 ? step : 1);
+    }
+    if (sched->mlfq_boost > 0 && sched->mlfq_next_boost < next)
+        next = sched->mlfq_next_boost;
+    return next;
+}
+
+static void init_mlfq(void) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int i;
+    init_mlq();
+    sched->mlfq_step = cur_ctx->mlfq_step > 0 ? cur_ctx->mlfq_step
+                                              : MLFQ_STEP;
+    sched->mlfq_age = cur_ctx->mlfq_age >= 0
+                          ? cur_ctx->mlfq_age
+                          : MLFQ_AGE_QUANTA * cur_ctx->time_slot;
+    sched->mlfq_boost = cur_ctx->mlfq_boost >= 0
+                            ? cur_ctx->mlfq_boost
+                            : MLFQ_BOOST_QUANTA * cur_ctx->time_slot;
+    sched->mlfq_next_boost = sched->mlfq_boost;
+    atomic_init(&sched->mlfq_next_pass, mlfq_next_pass(sched, 0));
+    atomic_init(&sched->mlfq_boosts, 0);
+    atomic_init(&sched->mlfq_demotions, 0);
+    atomic_init(&sched->mlfq_promotions, 0);
+    for (i = 0; i < MAX_PRIO; i++)
+        atomic_init(&sched->residency[i], 0);
+}
+
+static struct pcb_t *get_mlfq_proc(void) {
+    struct sched_state *sched = &cur_ctx->sched;
+    uint64_t now = current_time();
+    uint64_t due = atomic_load(&sched->mlfq_next_pass);
+    /* Whoever takes the pass holds the others off until it is done */
+    if (now >= due && atomic_compare_exchange_strong(&sched->mlfq_next_pass,
+                                                     &due, SLOT_NEVER)) {
+        mlfq_pass(sched, now);
+        atomic_store(&sched->mlfq_next_pass, mlfq_next_pass(sched, now));
+        /* A CPU may have found the queues empty halfway through */
+        wake_idle_cpu(-1, AFFINITY_ANY);
+    }
+    return get_mlq_proc();
+}
 
-    pthread_mutex_lock(&queue_lock);
-    enqueue(&ready_queue, proc);
-    pthread_mutex_unlock(&queue_lock);    
+static void put_mlfq_proc(struct pcb_t *proc) {
+    struct sched_state *sched = &cur_ctx->sched;
+    if (proc == NULL)
+        return;
+    mlfq_catch_up(sched, proc);
+    trace(put_proc, proc->pid, proc->prio, 0);
+    rq_add(put_rq(sched, proc), proc);
 }
+
+static void mlfq_expire(struct pcb_t *proc) {
+    struct sched_state *sched = &cur_ctx->sched;
+    unsigned int boosts = proc->boosts;
+    mlfq_catch_up(sched, proc);
+    if (proc->boosts == boosts && proc->prio < MAX_PRIO - 1) {
+        uint32_t prio = proc->prio + sched->mlfq_step;
+        mlfq_move(sched, proc, prio < MAX_PRIO ? prio : MAX_PRIO - 1);
+        atomic_fetch_add(&sched->mlfq_demotions, 1);
+    }
+}
+
+static void mlfq_exit(struct pcb_t *proc) {
+    struct sched_state *sched = &cur_ctx->sched;
+    atomic_fetch_add(&sched->residency[proc->prio],
+                     current_time() - proc->level_since);
+}
+
+const struct sched_ops mlfq_sched_ops = {
+    .name = "mlfq",
+    .init = init_mlfq,
+    .finish = finish_mlq,
+    .pick_next = get_mlfq_proc,
+    .enqueue = put_mlfq_proc,
+    .requeue = put_mlfq_proc,
+    .expire = mlfq_expire,
+    .on_exit = mlfq_exit,
+    .keep = mlq_keep,
+    .rank = mlq_rank,
+    .depth = mlq_depth,
+    .empty = mlq_empty,
+    .unqueue = mlq_unqueue,
+};
 #endif
 
+///////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////// NORMAL SCHED /////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////
+
+/* New processes wait in ready_queue and preempted ones in run_queue,
+ * which is only served once ready_queue is empty. Both are heaps on
+ * the priority, equal ones served first in, first out */
+
+static int allowed_on(const struct pcb_t *proc, const void *cpu) {
+    return proc_allowed(proc, *(const int *)cpu);
+}
+
+/* heap_pop(), among the processes [cpu] may run */
+static struct pcb_t * pop_allowed(struct proc_heap *h, int cpu) {
+    struct pcb_t *proc = heap_find(h, allowed_on, &cpu);
+    if (proc != NULL)
+        heap_remove(h, proc);
+    return proc;
+}
+
+static struct pcb_t * get_fifo_proc(void) {
+    struct sched_state *sched = &cur_ctx->sched;
+    struct pcb_t * proc = NULL;
+    pthread_mutex_lock(&sched->queue_lock);
+    if (cur_ctx->has_affinity) {
+        proc = pop_allowed(&sched->ready_queue, cur_cpu);
+        if (proc == NULL)
+            proc = pop_allowed(&sched->run_queue, cur_cpu);
+    } else if (!heap_empty(&sched->ready_queue))
+        proc = heap_pop(&sched->ready_queue);
+    else
+        proc = heap_pop(&sched->run_queue);
+    pthread_mutex_unlock(&sched->queue_lock);
+    if (proc != NULL)
+        trace(get_proc, proc->pid, 0, 0);
+    return proc;
+}
+
+static uint64_t fifo_rank(const struct pcb_t *proc) {
+    return proc_prio(proc);
+}
+
+static void requeue_fifo_proc(struct pcb_t * proc) {
+    struct sched_state *sched = &cur_ctx->sched;
+    trace(put_proc, proc->pid, 0, 0);
+    pthread_mutex_lock(&sched->queue_lock);
+    heap_push(&sched->run_queue, proc, proc_prio(proc));
+    pthread_mutex_unlock(&sched->queue_lock);
+}
+
+static void enqueue_fifo_proc(struct pcb_t * proc) {
+    struct sched_state *sched = &cur_ctx->sched;
+    pthread_mutex_lock(&sched->queue_lock);
+    heap_push(&sched->ready_queue, proc, proc_prio(proc));
+    pthread_mutex_unlock(&sched->queue_lock);    
+}
+
+static int fifo_empty(void) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int ret;
+    pthread_mutex_lock(&sched->queue_lock);
+    ret = heap_empty(&sched->ready_queue) && heap_empty(&sched->run_queue);
+    pthread_mutex_unlock(&sched->queue_lock);
+    return ret;
+}
+
+static int fifo_unqueue(struct pcb_t **procs, int n) {
+    struct sched_state *sched = &cur_ctx->sched;
+    int i, k = 0;
+    pthread_mutex_lock(&sched->queue_lock);
+    for (i = 0; i < n; i++)
+        if (heap_has(&sched->ready_queue, procs[i]) ||
+            heap_has(&sched->run_queue, procs[i]))
+            procs[k++] = procs[i];
+    heap_remove_many(&sched->ready_queue, procs, k);
+    heap_remove_many(&sched->run_queue, procs, k);
+    pthread_mutex_unlock(&sched->queue_lock);
+    return k;
+}
+
+const struct sched_ops fifo_sched_ops = {
+    .name = "fifo",
+    .pick_next = get_fifo_proc,
+    .enqueue = enqueue_fifo_proc,
+    .requeue = requeue_fifo_proc,
+    .rank = fifo_rank,
+    .empty = fifo_empty,
+    .unqueue = fifo_unqueue,
+};
@@ -0,0 +1,179 @@
+#include "sched.h"
+#include "os-ctx.h"
+#include <pthread.h>
+
+/* CFS-like policy ("cfs" in the config file). Every runnable process
+ * sits in one red-black tree keyed by its virtual runtime, the slots
+ * it has run scaled down by its weight, and the CPUs always dispatch
+ * the leftmost one: the process that got the least CPU for its share.
+ * Picking and queueing cost O(log n) whatever the number of processes,
+ * and the tree is unbounded.
+ *
+ * The weight comes from the priority, mapped onto the 40 nice levels
+ * of Linux and their weights, each level getting about 1.25 times the
+ * CPU of the next. A process just loaded starts at min_vruntime, which
+ * follows the vruntime of the processes dispatched and never goes back,
+ * so it neither owes nor is owed anything. Equal vruntimes are served
+ * first in, first out.
+ *
+ * A CPU takes the leftmost process it may run. With -a it rather takes
+ * one that last ran on it, among the few next ones at most warm_tol
+ * slots of vruntime further right.
+ *
+ * The tree is shared by all CPUs under queue_lock; -q does not apply. */
+
+#define NICE_0_WEIGHT 1024
+#define CFS_NICE_LEVELS 40
+
+/* vruntime a process of weight NICE_0_WEIGHT gains per slot */
+#define CFS_SLOT_VRUNTIME 1024
+
+/* Processes looked at past the leftmost allowed one for a warm one */
+#define CFS_WARM_SCAN 8
+
+static const uint32_t cfs_weight[CFS_NICE_LEVELS] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */  9548,  7620,  6100,  4904,  3906,
+	/*  -5 */  3121,  2501,  1991,  1586,  1277,
+	/*   0 */  1024,   820,   655,   526,   423,
+	/*   5 */   335,   272,   215,   172,   137,
+	/*  10 */   110,    87,    70,    56,    45,
+	/*  15 */    36,    29,    23,    18,    15,
+};
+
+static uint32_t proc_weight(struct pcb_t * proc) {
+	uint32_t prio = proc_prio(proc);
+	if (prio >= MAX_PRIO) {
+		prio = MAX_PRIO - 1;
+	}
+	return cfs_weight[prio * CFS_NICE_LEVELS / MAX_PRIO];
+}
+
+static int vruntime_less(const struct rb_node * a, const struct rb_node * b) {
+	return rb_entry(a, struct pcb_t, cfs_node)->vruntime <
+		rb_entry(b, struct pcb_t, cfs_node)->vruntime;
+}
+
+void cfs_insert(struct pcb_t * proc) {
+	rb_insert(&cur_ctx->sched.cfs_tree, &proc->cfs_node, vruntime_less);
+}
+
+/* The process of the tree the calling CPU should take, NULL if none */
+static struct pcb_t * cfs_best(struct sched_state * sched) {
+	struct rb_node * node;
+	struct pcb_t * best = NULL;
+	uint64_t limit = 0;
+	int cpu = cur_cpu, scanned = 0;
+	for (node = sched->cfs_tree.first; node != NULL; node = rb_next(node)) {
+		struct pcb_t * proc = rb_entry(node, struct pcb_t, cfs_node);
+		if (best != NULL &&
+		    (proc->vruntime > limit || ++scanned > CFS_WARM_SCAN)) {
+			break;
+		}
+		if (!proc_allowed(proc, cpu)) {
+			continue;
+		}
+		if (best == NULL) {
+			best = proc;
+			if (cur_ctx->warm_tol < 0 || proc->last_cpu == cpu) {
+				break;
+			}
+			limit = proc->vruntime +
+				(uint64_t)cur_ctx->warm_tol * CFS_SLOT_VRUNTIME;
+		}else if (proc->last_cpu == cpu) {
+			best = proc;
+			break;
+		}
+	}
+	return best;
+}
+
+static struct pcb_t * cfs_pick_next(void) {
+	struct sched_state * sched = &cur_ctx->sched;
+	struct pcb_t * proc;
+	pthread_mutex_lock(&sched->queue_lock);
+	if ((proc = cfs_best(sched)) != NULL) {
+		rb_erase(&sched->cfs_tree, &proc->cfs_node);
+		if (proc->vruntime > sched->min_vruntime) {
+			sched->min_vruntime = proc->vruntime;
+		}
+	}
+	pthread_mutex_unlock(&sched->queue_lock);
+	if (proc != NULL) {
+		trace(get_proc, proc->pid, proc_prio(proc), 0);
+	}
+	return proc;
+}
+
+static void cfs_enqueue(struct pcb_t * proc) {
+	struct sched_state * sched = &cur_ctx->sched;
+	pthread_mutex_lock(&sched->queue_lock);
+	proc->vruntime = sched->min_vruntime;
+	cfs_insert(proc);
+	pthread_mutex_unlock(&sched->queue_lock);
+}
+
+static void cfs_requeue(struct pcb_t * proc) {
+	struct sched_state * sched = &cur_ctx->sched;
+	trace(put_proc, proc->pid, proc_prio(proc), 0);
+	pthread_mutex_lock(&sched->queue_lock);
+	cfs_insert(proc);
+	pthread_mutex_unlock(&sched->queue_lock);
+}
+
+static void cfs_tick(struct pcb_t * proc) {
+	proc->vruntime += (uint64_t)CFS_SLOT_VRUNTIME * NICE_0_WEIGHT /
+		proc_weight(proc);
+}
+
+static int cfs_keep(struct pcb_t * proc) {
+	struct sched_state * sched = &cur_ctx->sched;
+	int ret = 1;
+	pthread_mutex_lock(&sched->queue_lock);
+	if (sched->cfs_tree.first != NULL) {
+		struct pcb_t * first = rb_entry(sched->cfs_tree.first,
+						struct pcb_t, cfs_node);
+		ret = proc->vruntime < first->vruntime +
+			(uint64_t)cur_ctx->warm_tol * CFS_SLOT_VRUNTIME;
+	}
+	if (ret && proc->vruntime > sched->min_vruntime) {
+		sched->min_vruntime = proc->vruntime;
+	}
+	pthread_mutex_unlock(&sched->queue_lock);
+	return ret;
+}
+
+static int cfs_empty(void) {
+	struct sched_state * sched = &cur_ctx->sched;
+	int ret;
+	pthread_mutex_lock(&sched->queue_lock);
+	ret = rb_empty(&sched->cfs_tree);
+	pthread_mutex_unlock(&sched->queue_lock);
+	return ret;
+}
+
+static int cfs_unqueue(struct pcb_t ** procs, int n) {
+	struct sched_state * sched = &cur_ctx->sched;
+	int i, k = 0;
+	pthread_mutex_lock(&sched->queue_lock);
+	for (i = 0; i < n; i++) {
+		if (rb_linked(&procs[i]->cfs_node)) {
+			rb_erase(&sched->cfs_tree, &procs[i]->cfs_node);
+			procs[k++] = procs[i];
+		}
+	}
+	pthread_mutex_unlock(&sched->queue_lock);
+	return k;
+}
+
+const struct sched_ops cfs_sched_ops = {
+	.name = "cfs",
+	.pick_next = cfs_pick_next,
+	.enqueue = cfs_enqueue,
+	.requeue = cfs_requeue,
+	.tick = cfs_tick,
+	.keep = cfs_keep,
+	.empty = cfs_empty,
+	.unqueue = cfs_unqueue,
+};
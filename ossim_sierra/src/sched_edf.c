@@ -0,0 +1,122 @@
+#include "sched.h"
+#include "os-ctx.h"
+#include <pthread.h>
+
+/* Earliest deadline first ("edf" in the config file). Runnable
+ * processes wait in a binary min-heap on their absolute deadline, the
+ * slot they were loaded in plus the relative deadline of their config
+ * line, and the CPUs always dispatch the most urgent one. Processes
+ * without a deadline come after every process that has one, in the
+ * order they were queued. A process only gives up its CPU at the end
+ * of its quantum, as under the other policies.
+ *
+ * A CPU takes the most urgent process it may run. With -a it rather
+ * takes the most urgent of those that last ran on it, if due at most
+ * warm_tol slots after that one.
+ *
+ * The heap (heap.c) grows as needed and is shared by all CPUs under
+ * queue_lock; -q does not apply. */
+
+static int allowed_on(const struct pcb_t * proc, const void * cpu) {
+	return proc_allowed(proc, *(const int *)cpu);
+}
+
+static int warm_on(const struct pcb_t * proc, const void * cpu) {
+	return proc_allowed(proc, *(const int *)cpu) &&
+		proc->last_cpu == *(const int *)cpu;
+}
+
+static uint64_t add_tol(uint64_t deadline) {
+	uint64_t tol = cur_ctx->warm_tol;
+	return deadline > UINT64_MAX - tol ? UINT64_MAX : deadline + tol;
+}
+
+static struct pcb_t * edf_pick_next(void) {
+	struct sched_state * sched = &cur_ctx->sched;
+	struct proc_heap * h = &sched->edf_heap;
+	struct pcb_t * proc;
+	struct pcb_t * warm;
+	int cpu = cur_cpu;
+	pthread_mutex_lock(&sched->queue_lock);
+	proc = heap_find(h, allowed_on, &cpu);
+	if (proc != NULL && cur_ctx->warm_tol >= 0 && proc->last_cpu != cpu &&
+	    (warm = heap_find_upto(h, add_tol(proc->deadline), warm_on,
+				   &cpu)) != NULL) {
+		proc = warm;
+	}
+	if (proc != NULL) {
+		heap_remove(h, proc);
+	}
+	pthread_mutex_unlock(&sched->queue_lock);
+	if (proc != NULL) {
+		trace(get_proc, proc->pid, 0, 0);
+	}
+	return proc;
+}
+
+static void edf_enqueue(struct pcb_t * proc) {
+	struct sched_state * sched = &cur_ctx->sched;
+	pthread_mutex_lock(&sched->queue_lock);
+	heap_push(&sched->edf_heap, proc, proc->deadline);
+	pthread_mutex_unlock(&sched->queue_lock);
+}
+
+static void edf_requeue(struct pcb_t * proc) {
+	trace(put_proc, proc->pid, 0, 0);
+	edf_enqueue(proc);
+}
+
+static int edf_keep(struct pcb_t * proc) {
+	struct sched_state * sched = &cur_ctx->sched;
+	int ret;
+	pthread_mutex_lock(&sched->queue_lock);
+	if (heap_empty(&sched->edf_heap)) {
+		ret = 1;
+	}else{
+		/* A tie would be queued ahead of it */
+		uint64_t first = heap_first(&sched->edf_heap)->deadline;
+		ret = proc->deadline != first &&
+			proc->deadline <= add_tol(first);
+	}
+	pthread_mutex_unlock(&sched->queue_lock);
+	return ret;
+}
+
+static uint64_t edf_rank(const struct pcb_t * proc) {
+	/* After every deadline, still below RANK_IDLE */
+	return proc->deadline == UINT64_MAX ? RANK_IDLE - 1 : proc->deadline;
+}
+
+static int edf_empty(void) {
+	struct sched_state * sched = &cur_ctx->sched;
+	int ret;
+	pthread_mutex_lock(&sched->queue_lock);
+	ret = heap_empty(&sched->edf_heap);
+	pthread_mutex_unlock(&sched->queue_lock);
+	return ret;
+}
+
+static int edf_unqueue(struct pcb_t ** procs, int n) {
+	struct sched_state * sched = &cur_ctx->sched;
+	int i, k = 0;
+	pthread_mutex_lock(&sched->queue_lock);
+	for (i = 0; i < n; i++) {
+		if (heap_has(&sched->edf_heap, procs[i])) {
+			procs[k++] = procs[i];
+		}
+	}
+	heap_remove_many(&sched->edf_heap, procs, k);
+	pthread_mutex_unlock(&sched->queue_lock);
+	return k;
+}
+
+const struct sched_ops edf_sched_ops = {
+	.name = "edf",
+	.pick_next = edf_pick_next,
+	.enqueue = edf_enqueue,
+	.requeue = edf_requeue,
+	.keep = edf_keep,
+	.rank = edf_rank,
+	.empty = edf_empty,
+	.unqueue = edf_unqueue,
+};
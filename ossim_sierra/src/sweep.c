@@ -0,0 +1,210 @@
+/* Parameter sweep. Every point of the grid given on the command line is
+ * an independent instance (struct os_ctx) cloned from the base
+ * configuration and run silently with the sequential engine. Instances
+ * share nothing, so they are simply handed out to a pool of host
+ * threads; the summary is printed in grid order once all are done. */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "os-ctx.h"
+
+#define SWEEP_MAX_VALUES 32
+
+enum sweep_key_t {
+	SWEEP_SLOT,
+	SWEEP_CPUS,
+	SWEEP_RAM,
+	SWEEP_SWAP,
+	SWEEP_NKEYS,
+};
+
+static const char * sweep_key_name[SWEEP_NKEYS] = {
+	"slot", "cpus", "ram", "swap",
+};
+
+/* Smallest value accepted for each key */
+static const int sweep_key_min[SWEEP_NKEYS] = {
+	1, 1, 1, 0,
+};
+
+struct sweep_axis_t {
+	int nval;		/* 0 when the base value is kept */
+	int val[SWEEP_MAX_VALUES];
+};
+
+struct sweep_run_t {
+	struct os_ctx * ctx;
+	int param[SWEEP_NKEYS];
+	uint64_t makespan;
+	double ms;
+};
+
+struct sweep_pool_t {
+	struct sweep_run_t * runs;
+	int nruns;
+	atomic_int next;
+};
+
+/* "slot=1,2,4:cpus=1,2" */
+static int parse_spec(const char * spec, struct sweep_axis_t * axis) {
+	char * buf = strdup(spec);
+	char * save_field;
+	char * field;
+	int ret = 0;
+
+	for (field = strtok_r(buf, ":", &save_field); field != NULL;
+	     field = strtok_r(NULL, ":", &save_field)) {
+		char * eq = strchr(field, '=');
+		int key;
+		if (eq == NULL) {
+			ret = -1;
+			break;
+		}
+		*eq = '\0';
+		for (key = 0; key < SWEEP_NKEYS; key++) {
+			if (!strcmp(field, sweep_key_name[key])) break;
+		}
+		if (key == SWEEP_NKEYS) {
+			ret = -1;
+			break;
+		}
+
+		char * save_val;
+		char * val;
+		axis[key].nval = 0;
+		for (val = strtok_r(eq + 1, ",", &save_val); val != NULL;
+		     val = strtok_r(NULL, ",", &save_val)) {
+			if (axis[key].nval == SWEEP_MAX_VALUES ||
+			    atoi(val) < sweep_key_min[key]) {
+				ret = -1;
+				break;
+			}
+			axis[key].val[axis[key].nval++] = atoi(val);
+		}
+		if (ret != 0 || axis[key].nval == 0) {
+			ret = -1;
+			break;
+		}
+	}
+	free(buf);
+	return ret;
+}
+
+static void * sweep_worker(void * arg) {
+	struct sweep_pool_t * pool = (struct sweep_pool_t *)arg;
+	int i;
+	while ((i = atomic_fetch_add(&pool->next, 1)) < pool->nruns) {
+		struct sweep_run_t * run = &pool->runs[i];
+		struct timespec start, end;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		os_run(run->ctx, 1);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		run->makespan = run->ctx->timer.time;
+		run->ms = (end.tv_sec - start.tv_sec) * 1e3 +
+			(end.tv_nsec - start.tv_nsec) / 1e6;
+	}
+	return NULL;
+}
+
+int run_sweep(const struct os_ctx * base, const char * spec, int jobs) {
+	struct sweep_axis_t axis[SWEEP_NKEYS];
+	int base_param[SWEEP_NKEYS];
+	int nruns = 1;
+	int key, i;
+
+	memset(axis, 0, sizeof(axis));
+	if (parse_spec(spec, axis) != 0) {
+		printf("Invalid sweep specification '%s'\n", spec);
+		return 1;
+	}
+
+	base_param[SWEEP_SLOT] = base->time_slot;
+	base_param[SWEEP_CPUS] = base->num_cpus;
+#ifdef MM_PAGING
+	base_param[SWEEP_RAM] = base->memramsz;
+	base_param[SWEEP_SWAP] = base->memswpsz[0];
+#else
+	base_param[SWEEP_RAM] = 0;
+	base_param[SWEEP_SWAP] = 0;
+#endif
+	for (key = 0; key < SWEEP_NKEYS; key++) {
+		if (axis[key].nval == 0) {
+			axis[key].nval = 1;
+			axis[key].val[0] = base_param[key];
+		}
+		nruns *= axis[key].nval;
+	}
+
+	/* Expand the grid, the last key varying fastest */
+	struct sweep_run_t * runs = calloc(nruns, sizeof(struct sweep_run_t));
+	for (i = 0; i < nruns; i++) {
+		struct sweep_run_t * run = &runs[i];
+		int rest = i;
+		for (key = SWEEP_NKEYS - 1; key >= 0; key--) {
+			run->param[key] = axis[key].val[rest % axis[key].nval];
+			rest /= axis[key].nval;
+		}
+		run->ctx = os_ctx_clone(base);
+		run->ctx->out = NULL;
+		run->ctx->time_slot = run->param[SWEEP_SLOT];
+		run->ctx->num_cpus = run->param[SWEEP_CPUS];
+#ifdef MM_PAGING
+		run->ctx->memramsz = run->param[SWEEP_RAM];
+		run->ctx->memswpsz[0] = run->param[SWEEP_SWAP];
+#endif
+	}
+
+	if (jobs <= 0) {
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (jobs > nruns) {
+		jobs = nruns;
+	}
+	struct sweep_pool_t pool = {.runs = runs, .nruns = nruns};
+	atomic_init(&pool.next, 0);
+	pthread_t * workers = malloc(jobs * sizeof(pthread_t));
+	for (i = 0; i < jobs; i++) {
+		pthread_create(&workers[i], NULL, sweep_worker, &pool);
+	}
+	for (i = 0; i < jobs; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	free(workers);
+
+	printf("%5s %5s %8s %8s %9s %6s %8s %10s %8s %8s %7s %6s %9s\n",
+	       "slot", "cpus", "ram", "swap", "makespan", "busy%",
+	       "idlerdy", "dispatches", "faults", "afails", "dmissed", "migr",
+	       "ms");
+	for (i = 0; i < nruns; i++) {
+		struct sweep_run_t * run = &runs[i];
+		struct os_stats * st = &run->ctx->stats;
+		unsigned long busy = atomic_load(&st->busy_slots);
+		unsigned long total = busy + atomic_load(&st->idle_slots);
+		unsigned long missed = 0;
+		int b;
+		for (b = 1; b < LATENESS_BUCKETS; b++) {
+			missed += atomic_load(&st->lateness[b]);
+		}
+		printf("%5d %5d %8d %8d %9lu %6.1f %8lu %10lu %8lu %8lu %7lu %6lu %9.2f\n",
+		       run->param[SWEEP_SLOT], run->param[SWEEP_CPUS],
+		       run->param[SWEEP_RAM], run->param[SWEEP_SWAP],
+		       (unsigned long)run->makespan,
+		       total ? 100.0 * busy / total : 0.0,
+		       atomic_load(&st->idle_ready),
+		       atomic_load(&st->dispatches),
+		       atomic_load(&st->page_faults),
+		       atomic_load(&st->alloc_fails), missed,
+		       atomic_load(&st->migrations), run->ms);
+		os_ctx_destroy(run->ctx);
+	}
+	free(runs);
+	return 0;
+}
@@ -13,10 +13,22 @@
 #include "stdio.h"
 #include "libmem.h"
 #include "queue.h"
+#include "os-ctx.h"
 #include "string.h"
 #include <stdlib.h>
 
 
+/* The scheduler frees the PCB itself afterwards */
+static void terminate(struct pcb_t *proc)
+{
+    os_printf("Terminated process PID %d with name \"%s\"\n", proc->pid, proc->path);
+
+    free(proc->code);
+#ifdef MM_PAGING
+    if (proc->mm) free(proc->mm);
+#endif
+}
+
 int __sys_killall(struct pcb_t *caller, struct sc_regs* regs)
 {
     char proc_name[100];
@@ -35,55 +47,10 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs* regs)
         i++;
     }
     proc_name[i] = '\0';
-    printf("The procname retrieved from memregionid %d is \"%s\"\n", memrg, proc_name);
-
-    for (int lvl = 0; lvl < MAX_PRIO; lvl++) {
-        struct queue_t *queue = &caller->mlq_ready_queue[lvl]; 
-        if (!queue || empty(queue)) continue;
-
-        int idx = 0;
-        while (idx < queue->size) {
-            struct pcb_t *proc = queue->proc[idx];
-            if (proc && strcmp(proc->path, proc_name) == 0) {
-                printf("Terminated process PID %d with name \"%s\"\n", proc->pid, proc->path);
-
-                free(proc->code);
-#ifdef MM_PAGING
-                if (proc->mm) free(proc->mm);
-#endif
-                for (int k = idx; k < queue->size - 1; k++) {
-                    queue->proc[k] = queue->proc[k + 1];
-                }
-                queue->proc[queue->size - 1] = NULL;
-                queue->size--;
-            } else {
-                idx++;
-            }
-        }
-    }
-
-    struct queue_t *run_queue = caller->running_list;
-    if (run_queue && !empty(run_queue)) {
-        int idx = 0;
-        while (idx < run_queue->size) {
-            struct pcb_t *proc = run_queue->proc[idx];
-            if (proc && strcmp(proc->path, proc_name) == 0) {
-                printf("Terminated running process PID %d with name \"%s\"\n", proc->pid, proc->path);
+    os_printf("The procname retrieved from memregionid %d is \"%s\"\n", memrg, proc_name);
 
-                free(proc->code);
-#ifdef MM_PAGING
-                if (proc->mm) free(proc->mm);
-#endif
-                for (int k = idx; k < run_queue->size - 1; k++) {
-                    run_queue->proc[k] = run_queue->proc[k + 1];
-                }
-                run_queue->proc[run_queue->size - 1] = NULL;
-                run_queue->size--;
-            } else {
-                idx++;
-            }
-        }
-    }
+    /* Queued processes only: the caller and the others on a CPU run on */
+    sched_remove_procs(proc_name, terminate);
 
     return 0; 
 }
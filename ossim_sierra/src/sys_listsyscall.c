@@ -9,11 +9,12 @@
  */
 
 #include "syscall.h"
+#include "os-ctx.h"
 
 int __sys_listsyscall(struct pcb_t *caller, struct sc_regs* reg)
 {
    for (int i = 0; i < syscall_table_size; i++)
-       printf("%s\n",sys_call_table[i]); 
+       os_printf("%s\n",sys_call_table[i]); 
 
    return 0;
 }
@@ -1,137 +1,311 @@
 
 #include "timer.h"
+#include "os-ctx.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
-
-static pthread_t _timer;
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <unistd.h>
 
 struct timer_id_container_t {
 	struct timer_id_t id;
+	atomic_int parked;	/* Sleeping on wake, waiting for a post */
+	_Atomic uint64_t until;	/* Slot it waits for */
+	atomic_int out;		/* Parked out of the barrier */
+	atomic_uint park_gen;	/* Generation it parked in */
+	atomic_uint rejoin;	/* Generation it steps in again */
+	sem_t wake;
 	struct timer_id_container_t * next;
 };
 
-static struct timer_id_container_t * dev_list = NULL;
-
-static uint64_t _time;
-
-static int timer_started = 0;
-static int timer_stop = 0;
-
-
-static void * timer_routine(void * args) {
-	while (!timer_stop) {
-		printf("Time slot %3lu\n", current_time());
-		int fsh = 0;
-		int event = 0;
-		/* Wait for all devices have done the job in current
-		 * time slot */
-		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.event_lock);
-			while (!temp->id.done && !temp->id.fsh) {
-				pthread_cond_wait(
-					&temp->id.event_cond,
-					&temp->id.event_lock
-				);
-			}
-			if (temp->id.fsh) {
-				fsh++;
+/* Slot barrier. Every attached device arrives once per slot, either
+ * through next_slot() or for the last time through detach_event().
+ * The last one to arrive closes the slot: it advances the time,
+ * re-arms the barrier for the devices still attached and bumps the
+ * generation word. The others spin on that word for a while and then
+ * park on their own semaphore, so the closer only wakes (one by one,
+ * without any shared lock to fight over) the devices that really went
+ * to sleep. */
+#define BAR_SPIN_MAX 2000
+
+/* Fast-forward. Devices that can make no progress arrive through
+ * next_slot_idle() together with the first slot in which they will have
+ * work again. When every device still attached was idle, the closer
+ * jumps straight to the earliest such slot instead of running (and
+ * printing) the empty slots in between. */
+
+/* Lookahead. A CPU that already knows its next k slots touch nothing
+ * shared runs them ahead and arrives through next_slot_ahead(): it is
+ * counted as arrived in ahead[] for each of those slots and sleeps
+ * until the one after. Slots in which every attached device is ahead
+ * are closed back to back by the same closer. */
+
+/* Parking. A device that will have nothing to do until another one
+ * hands it work announces itself with park_event(), checks once more
+ * that it has none, and leaves through next_slot_park(): it arrives in
+ * the current slot for the last time, as in detach_event(), and sleeps
+ * on its semaphore. unpark_event(), run by the device handing it work
+ * from within its own step, counts it in again: in the current slot if
+ * it parked in an earlier one, so that it takes its step right after
+ * the caller's as in the sequential order, or else from the next slot
+ * on. The slot cannot close in between, as the caller has not arrived
+ * yet. Either side may come first, the counts of active and remaining
+ * devices only have to be right by the time the slot closes. */
+
+/* Slots (generations) still missing before [target] is reached */
+static int gen_before(struct timer_state * t, unsigned int target) {
+	return (int)(target - atomic_load_explicit(&t->gen,
+						   memory_order_acquire)) > 0;
+}
+
+static void bar_wait(struct timer_id_container_t * dev, unsigned int target) {
+	struct timer_state * t = &cur_ctx->timer;
+	int spin;
+	for (spin = 0; spin < t->spin; spin++) {
+		if (!gen_before(t, target)) {
+			return;
+		}
+	}
+	while (gen_before(t, target)) {
+		atomic_store(&dev->parked, 1);
+		if (!gen_before(t, target)) {
+			/* Slot closed meanwhile, take back the request
+			 * unless the closer already posted for it */
+			if (atomic_exchange(&dev->parked, 0) == 1) {
+				break;
 			}
-			event++;
-			pthread_mutex_unlock(&temp->id.event_lock);
 		}
+		/* The post may also come from a closer still walking
+		 * the list for the previous slot, hence the loop */
+		while (sem_wait(&dev->wake) != 0);
+	}
+}
 
-		/* Increase the time slot */
-		_time++;
-		
-		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.timer_lock);
-			temp->id.done = 0;
-			pthread_cond_signal(&temp->id.timer_cond);
-			pthread_mutex_unlock(&temp->id.timer_lock);
+/* Run by the last device arriving in the current slot */
+static void close_slot(void) {
+	struct timer_state * t = &cur_ctx->timer;
+	int active = atomic_load(&t->active);
+	int idle = atomic_exchange(&t->idle, 0);
+	uint64_t wakeup = atomic_exchange(&t->wakeup, SLOT_NEVER);
+
+	int remaining;
+
+	/* Increase the time slot, or skip to the next known event when
+	 * nobody can make progress before it */
+	if (t->fast_forward && active > 0 && idle == active &&
+	    wakeup != SLOT_NEVER && wakeup > t->time + 1) {
+		t->time = wakeup;
+	}else{
+		t->time++;
+	}
+	for (;;) {
+		remaining = active - atomic_exchange(
+			&t->ahead[t->time % TIMER_AHEAD_SLOTS], 0);
+		trace(slot, t->time, active, idle);
+		if (active > 0) {
+			os_event(EV_SLOT, current_time(), 0, 0, 0);
 		}
-		if (fsh == event) {
+		if (remaining > 0 || active == 0) {
 			break;
 		}
+		/* Everybody already did this one */
+		atomic_fetch_add(&t->gen, 1);
+		t->time++;
+	}
+	atomic_store(&t->remaining, remaining);
+
+	/* Let devices continue their job */
+	uint64_t now = t->time;
+	atomic_fetch_add(&t->gen, 1);
+	struct timer_id_container_t * temp;
+	for (temp = t->dev_list; temp != NULL; temp = temp->next) {
+		if (atomic_load_explicit(&temp->until, memory_order_relaxed) <=
+		    now && atomic_exchange(&temp->parked, 0) == 1) {
+			sem_post(&temp->wake);
+		}
+	}
+}
+
+static void arrive(void) {
+	struct timer_state * t = &cur_ctx->timer;
+	if (atomic_fetch_sub(&t->remaining, 1) == 1) {
+		close_slot();
 	}
-	pthread_exit(args);
+}
+
+static void hint_idle(uint64_t wakeup) {
+	struct timer_state * t = &cur_ctx->timer;
+	uint64_t cur = atomic_load(&t->wakeup);
+	while (wakeup < cur &&
+	       !atomic_compare_exchange_weak(&t->wakeup, &cur, wakeup));
+	atomic_fetch_add(&t->idle, 1);
 }
 
 void next_slot(struct timer_id_t * timer_id) {
-	fflush(stdout);
+	struct timer_state * t = &cur_ctx->timer;
+	/* Sample the generation before arriving, the slot may be closed
+	 * by somebody else as soon as we are counted */
+	unsigned int gen = atomic_load_explicit(&t->gen, memory_order_acquire);
+
 	/* Tell to timer that we have done our job in current slot */
-	pthread_mutex_lock(&timer_id->event_lock);
 	timer_id->done = 1;
-	pthread_cond_signal(&timer_id->event_cond);
-	pthread_mutex_unlock(&timer_id->event_lock);
+	arrive();
 
 	/* Wait for going to next slot */
-	pthread_mutex_lock(&timer_id->timer_lock);
-	while (timer_id->done) {
-		pthread_cond_wait(
-			&timer_id->timer_cond,
-			&timer_id->timer_lock
-		);
+	bar_wait((struct timer_id_container_t *)timer_id, gen + 1);
+	timer_id->done = 0;
+}
+
+static void arrive_ahead(struct timer_id_container_t * dev, int k) {
+	struct timer_state * t = &cur_ctx->timer;
+	uint64_t now = t->time;
+	int i;
+
+	/* Counted for the next k slots before arriving in this one, so
+	 * that its closer already sees them */
+	for (i = 1; i <= k; i++) {
+		atomic_fetch_add(&t->ahead[(now + i) % TIMER_AHEAD_SLOTS], 1);
+	}
+	atomic_store_explicit(&dev->until, now + k + 1, memory_order_relaxed);
+	arrive();
+}
+
+void next_slot_ahead(struct timer_id_t * timer_id, int k) {
+	struct timer_state * t = &cur_ctx->timer;
+	unsigned int gen = atomic_load_explicit(&t->gen, memory_order_acquire);
+
+	timer_id->done = 1;
+	arrive_ahead((struct timer_id_container_t *)timer_id, k);
+	bar_wait((struct timer_id_container_t *)timer_id, gen + k + 1);
+	timer_id->done = 0;
+}
+
+void park_event(struct timer_id_t * timer_id) {
+	struct timer_id_container_t * dev =
+		(struct timer_id_container_t *)timer_id;
+	atomic_store(&dev->park_gen, atomic_load(&cur_ctx->timer.gen));
+	atomic_store(&dev->out, 1);
+}
+
+int unpark_event(struct timer_id_t * timer_id) {
+	struct timer_state * t = &cur_ctx->timer;
+	struct timer_id_container_t * dev =
+		(struct timer_id_container_t *)timer_id;
+	unsigned int gen;
+	int out = 1;
+	if (!atomic_compare_exchange_strong(&dev->out, &out, 0)) {
+		return 0;
 	}
-	pthread_mutex_unlock(&timer_id->timer_lock);
+	gen = atomic_load(&t->gen);
+	atomic_fetch_add(&t->active, 1);
+	if (gen != atomic_load(&dev->park_gen)) {
+		/* It has not arrived in this slot yet */
+		atomic_fetch_add(&t->remaining, 1);
+		atomic_store(&dev->rejoin, gen);
+	}else{
+		atomic_store(&dev->rejoin, gen + 1);
+	}
+	sem_post(&dev->wake);
+	return 1;
+}
+
+unsigned int next_slot_park(struct timer_id_t * timer_id) {
+	struct timer_state * t = &cur_ctx->timer;
+	struct timer_id_container_t * dev =
+		(struct timer_id_container_t *)timer_id;
+	unsigned int gen = atomic_load_explicit(&t->gen, memory_order_acquire);
+	unsigned int rejoin;
+
+	timer_id->done = 1;
+	atomic_fetch_sub(&t->active, 1);
+	arrive();
+
+	/* Only unpark_event() posts while out of the barrier */
+	while (sem_wait(&dev->wake) != 0);
+	rejoin = atomic_load(&dev->rejoin);
+	bar_wait(dev, rejoin);
+	timer_id->done = 0;
+	return rejoin - gen - 1;
+}
+
+void slot_ahead(struct timer_id_t * timer_id, int k) {
+	arrive_ahead((struct timer_id_container_t *)timer_id, k);
+}
+
+void slot_done(struct timer_id_t * timer_id) {
+	arrive();
+}
+
+void slot_idle(struct timer_id_t * timer_id, uint64_t wakeup) {
+	hint_idle(wakeup);
+	arrive();
+}
+
+void next_slot_idle(struct timer_id_t * timer_id, uint64_t wakeup) {
+	hint_idle(wakeup);
+	next_slot(timer_id);
+}
+
+void set_fast_forward(int enable) {
+	cur_ctx->timer.fast_forward = enable;
 }
 
 uint64_t current_time() {
-	return _time;
+	return cur_ctx->timer.time;
 }
 
 void start_timer() {
-	timer_started = 1;
-	pthread_create(&_timer, NULL, timer_routine, NULL);
+	struct timer_state * t = &cur_ctx->timer;
+	t->started = 1;
+	atomic_store(&t->idle, 0);
+	atomic_store(&t->wakeup, SLOT_NEVER);
+	t->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? BAR_SPIN_MAX : 0;
+	atomic_store(&t->remaining, atomic_load(&t->active));
 }
 
 void detach_event(struct timer_id_t * event) {
-	pthread_mutex_lock(&event->event_lock);
+	struct timer_state * t = &cur_ctx->timer;
 	event->fsh = 1;
-	pthread_cond_signal(&event->event_cond);
-	pthread_mutex_unlock(&event->event_lock);
+	atomic_fetch_sub(&t->active, 1);
+	arrive();
 }
 
 struct timer_id_t * attach_event() {
-	if (timer_started) {
+	struct timer_state * t = &cur_ctx->timer;
+	if (t->started) {
 		return NULL;
 	}else{
 		struct timer_id_container_t * container =
 			(struct timer_id_container_t*)malloc(
-				sizeof(struct timer_id_container_t)		
+				sizeof(struct timer_id_container_t)
 			);
 		container->id.done = 0;
 		container->id.fsh = 0;
-		pthread_cond_init(&container->id.event_cond, NULL);
-		pthread_mutex_init(&container->id.event_lock, NULL);
-		pthread_cond_init(&container->id.timer_cond, NULL);
-		pthread_mutex_init(&container->id.timer_lock, NULL);
-		if (dev_list == NULL) {
-			dev_list = container;
-			dev_list->next = NULL;
+		atomic_init(&container->parked, 0);
+		atomic_init(&container->until, 0);
+		atomic_init(&container->out, 0);
+		atomic_init(&container->park_gen, 0);
+		atomic_init(&container->rejoin, 0);
+		sem_init(&container->wake, 0, 0);
+		atomic_fetch_add(&t->active, 1);
+		if (t->dev_list == NULL) {
+			t->dev_list = container;
+			t->dev_list->next = NULL;
 		}else{
-			container->next = dev_list;
-			dev_list = container;
+			container->next = t->dev_list;
+			t->dev_list = container;
 		}
 		return &(container->id);
 	}
 }
 
 void stop_timer() {
-	timer_stop = 1;
-	pthread_join(_timer, NULL);
-	while (dev_list != NULL) {
-		struct timer_id_container_t * temp = dev_list;
-		dev_list = dev_list->next;
-		pthread_cond_destroy(&temp->id.event_cond);
-		pthread_mutex_destroy(&temp->id.event_lock);
-		pthread_cond_destroy(&temp->id.timer_cond);
-		pthread_mutex_destroy(&temp->id.timer_lock);
+	struct timer_state * t = &cur_ctx->timer;
+	while (t->dev_list != NULL) {
+		struct timer_id_container_t * temp = t->dev_list;
+		t->dev_list = t->dev_list->next;
+		sem_destroy(&temp->wake);
 		free(temp);
 	}
 }
-
-
-
-
@@ -0,0 +1,186 @@
+#include "trace.h"
+#include "os-ctx.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Every device (CPU 0..n-1, then the loader) owns a ring. Its producer
+ * is whichever host thread is stepping that device, so there is only
+ * ever one writer per ring and the collector is the only reader: the
+ * two indexes are enough, no lock and no CAS. A full ring drops the
+ * record rather than stalling the simulation. */
+
+#define TRACE_RING_SIZE 4096		/* Records, power of two */
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+#define TRACE_POLL_NS 1000000		/* Collector period */
+
+struct trace_ring {
+	_Alignas(64) atomic_ulong head;	/* Next record to write */
+	_Alignas(64) atomic_ulong tail;	/* Next record to drain */
+	atomic_ulong dropped;
+	struct trace_rec rec[TRACE_RING_SIZE];
+};
+
+struct trace_state {
+	int ndev;
+	struct trace_ring * ring;
+	FILE * out;
+	pthread_t collector;
+	atomic_int stop;
+};
+
+static const char * trace_name[TP_NR] = {
+#define TRACE_NAME(name, fmt) #name,
+	TRACE_POINTS(TRACE_NAME)
+#undef TRACE_NAME
+};
+
+static const char * trace_fmt[TP_NR] = {
+#define TRACE_FMT(name, fmt) fmt,
+	TRACE_POINTS(TRACE_FMT)
+#undef TRACE_FMT
+};
+
+unsigned char trace_on[TP_NR];
+__thread int trace_dev = -1;
+
+void trace_emit(int tp, uint32_t a0, uint64_t a1, uint64_t a2) {
+	struct trace_state * ts = cur_ctx->trace;
+	if (ts == NULL || trace_dev < 0 || trace_dev >= ts->ndev) {
+		return;
+	}
+	struct trace_ring * ring = &ts->ring[trace_dev];
+	unsigned long head = atomic_load_explicit(&ring->head,
+						  memory_order_relaxed);
+	if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) ==
+	    TRACE_RING_SIZE) {
+		atomic_fetch_add_explicit(&ring->dropped, 1,
+					  memory_order_relaxed);
+		return;
+	}
+	struct trace_rec * rec = &ring->rec[head & TRACE_RING_MASK];
+	rec->time = cur_ctx->timer.time;
+	rec->tp = tp;
+	rec->dev = trace_dev;
+	rec->a0 = a0;
+	rec->a1 = a1;
+	rec->a2 = a2;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+int trace_enable(const char * list) {
+	char * buf = strdup(list);
+	char * save;
+	char * name;
+	int ret = 0;
+	for (name = strtok_r(buf, ",", &save); name != NULL;
+	     name = strtok_r(NULL, ",", &save)) {
+		int tp;
+		if (!strcmp(name, "all")) {
+			memset(trace_on, 1, sizeof(trace_on));
+			continue;
+		}
+		for (tp = 0; tp < TP_NR; tp++) {
+			if (!strcmp(name, trace_name[tp])) break;
+		}
+		if (tp == TP_NR) {
+			ret = -1;
+			break;
+		}
+		trace_on[tp] = 1;
+	}
+	free(buf);
+	return ret;
+}
+
+int trace_enabled(void) {
+	int tp;
+	for (tp = 0; tp < TP_NR; tp++) {
+		if (trace_on[tp]) return 1;
+	}
+	return 0;
+}
+
+static void trace_drain(struct trace_state * ts) {
+	int dev;
+	for (dev = 0; dev < ts->ndev; dev++) {
+		struct trace_ring * ring = &ts->ring[dev];
+		unsigned long tail = atomic_load_explicit(&ring->tail,
+							  memory_order_relaxed);
+		unsigned long head = atomic_load_explicit(&ring->head,
+							  memory_order_acquire);
+		for (; tail != head; tail++) {
+			struct trace_rec * rec =
+				&ring->rec[tail & TRACE_RING_MASK];
+			char devname[16];
+			if (rec->dev == ts->ndev - 1) {
+				snprintf(devname, sizeof(devname), "ld");
+			}else{
+				snprintf(devname, sizeof(devname), "cpu%d",
+					 rec->dev);
+			}
+			fprintf(ts->out, "%6lu %-5s %-8s ",
+				(unsigned long)rec->time, devname,
+				trace_name[rec->tp]);
+			fprintf(ts->out, trace_fmt[rec->tp],
+				(unsigned long)rec->a0,
+				(unsigned long)rec->a1,
+				(unsigned long)rec->a2);
+			fputc('\n', ts->out);
+		}
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+	}
+}
+
+static void * trace_collector(void * arg) {
+	struct trace_state * ts = (struct trace_state *)arg;
+	struct timespec period = {0, TRACE_POLL_NS};
+	while (!atomic_load(&ts->stop)) {
+		trace_drain(ts);
+		nanosleep(&period, NULL);
+	}
+	trace_drain(ts);
+	return NULL;
+}
+
+int trace_start(struct os_ctx * ctx, const char * path) {
+	struct trace_state * ts = calloc(1, sizeof(struct trace_state));
+	if (path == NULL) {
+		ts->out = stderr;
+	}else if ((ts->out = fopen(path, "w")) == NULL) {
+		printf("Cannot open trace file %s\n", path);
+		free(ts);
+		return -1;
+	}
+	ts->ndev = ctx->num_cpus + 1;
+	ts->ring = aligned_alloc(_Alignof(struct trace_ring),
+				 ts->ndev * sizeof(struct trace_ring));
+	memset(ts->ring, 0, ts->ndev * sizeof(struct trace_ring));
+	atomic_init(&ts->stop, 0);
+	ctx->trace = ts;
+	pthread_create(&ts->collector, NULL, trace_collector, ts);
+	return 0;
+}
+
+void trace_stop(struct os_ctx * ctx) {
+	struct trace_state * ts = ctx->trace;
+	int dev;
+	atomic_store(&ts->stop, 1);
+	pthread_join(ts->collector, NULL);
+	for (dev = 0; dev < ts->ndev; dev++) {
+		unsigned long dropped = atomic_load(&ts->ring[dev].dropped);
+		if (dropped > 0) {
+			fprintf(ts->out, "# device %d dropped %lu records\n",
+				dev, dropped);
+		}
+	}
+	if (ts->out != stderr) {
+		fclose(ts->out);
+	}
+	free(ts->ring);
+	free(ts);
+	ctx->trace = NULL;
+}
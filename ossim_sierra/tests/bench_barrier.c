@@ -0,0 +1,73 @@
+/* Slot barrier throughput (timer.c): devices that do nothing but call
+ * next_slot(), a thread each, as the threaded engine runs them.
+ *
+ *   bench_barrier [SLOTS [CPUS...]]
+ *
+ * prints the slots per second for each number of CPUs, the best of
+ * BENCH_RUNS runs. Defaults: 2000 slots, 2 8 32 128 CPUs */
+
+#include "harness.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_RUNS 3
+
+static struct os_ctx * ctx;
+static int slots;
+
+static void * device(void * arg) {
+	struct timer_id_t * timer_id = arg;
+	int i;
+	cur_ctx = ctx;
+	for (i = 0; i < slots; i++) {
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	return NULL;
+}
+
+static double run(int cpus) {
+	pthread_t * thread = malloc(cpus * sizeof(pthread_t));
+	struct timer_id_t ** id = malloc(cpus * sizeof(struct timer_id_t *));
+	uint64_t start;
+	int i;
+	ctx = harness_ctx(NULL, cpus, 0, 0);
+	for (i = 0; i < cpus; i++) {
+		id[i] = attach_event();
+	}
+	start = now_ns();
+	start_timer();
+	for (i = 0; i < cpus; i++) {
+		pthread_create(&thread[i], NULL, device, id[i]);
+	}
+	for (i = 0; i < cpus; i++) {
+		pthread_join(thread[i], NULL);
+	}
+	stop_timer();
+	double sec = (now_ns() - start) / 1e9;
+	harness_free(ctx);
+	free(id);
+	free(thread);
+	return slots / sec;
+}
+
+int main(int argc, char * argv[]) {
+	static const int defaults[] = {2, 8, 32, 128};
+	int n = argc > 2 ? argc - 2 : 4;
+	int i, r;
+	slots = argc > 1 ? atoi(argv[1]) : 2000;
+	printf("%6s %10s\n", "cpus", "slots/sec");
+	for (i = 0; i < n; i++) {
+		int cpus = argc > 2 ? atoi(argv[i + 2]) : defaults[i];
+		double best = 0;
+		for (r = 0; r < BENCH_RUNS; r++) {
+			double rate = run(cpus);
+			if (rate > best) {
+				best = rate;
+			}
+		}
+		printf("%6d %10.0f\n", cpus, best);
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+/* Cost of a dispatch: get_proc() then put_proc() of what it returned,
+ * in a loop on one thread, with N processes queued over all priority
+ * levels (at priority 139 for a single one).
+ *
+ *   bench_dispatch [POLICY [N...]]
+ *
+ * prints the nanoseconds per dispatch for each N. Defaults: mlq, and
+ * 1, 1400 and 10000 processes */
+
+#include "harness.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_DISPATCHES 2000000
+
+static double run(const char * policy, int n) {
+	struct os_ctx * ctx = harness_ctx(policy, 1, 0, n);
+	struct pcb_t * procs = harness_procs(n);
+	uint64_t start;
+	long i;
+	for (i = 0; i < n; i++) {
+		procs[i].prio = procs[i].base_prio =
+			n == 1 ? MAX_PRIO - 1 : i % MAX_PRIO;
+		procs[i].priority = procs[i].prio;
+		add_proc(&procs[i]);
+	}
+	start = now_ns();
+	for (i = 0; i < BENCH_DISPATCHES; i++) {
+		put_proc(get_proc());
+	}
+	double ns = (double)(now_ns() - start) / BENCH_DISPATCHES;
+	harness_free(ctx);
+	free(procs);
+	return ns;
+}
+
+int main(int argc, char * argv[]) {
+	static const int defaults[] = {1, 1400, 10000};
+	const char * policy = argc > 1 ? argv[1] : "mlq";
+	int n = argc > 2 ? argc - 2 : 3;
+	int i;
+	if (sched_find(policy) == NULL) {
+		fprintf(stderr, "No policy %s\n", policy);
+		return 1;
+	}
+	printf("%-6s %8s %12s\n", "policy", "procs", "ns/dispatch");
+	for (i = 0; i < n; i++) {
+		int procs = argc > 2 ? atoi(argv[i + 2]) : defaults[i];
+		printf("%-6s %8d %12.1f\n", policy, procs, run(policy, procs));
+	}
+	return 0;
+}
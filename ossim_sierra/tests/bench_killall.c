@@ -0,0 +1,118 @@
+/* Cost of killall (sched_remove_procs()) with N processes queued over
+ * all priority levels of 8 CPUs, run queues of their own under mlq and
+ * mlfq (-q), and one more process on each CPU: the time to kill those
+ * of one name, one process in ten, and to kill all of them at once.
+ * Includes handing each one to the killer and freeing it.
+ *
+ *   bench_killall [N...]
+ *
+ * prints the microseconds per call for each policy and N, the best of
+ * BENCH_RUNS runs, and exits with status 1 if a call killed a process
+ * on a CPU or left one of the name queued. Defaults: 1000 and 10000 */
+
+#include "harness.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_CPUS 8
+#define BENCH_RUNS 5
+#define KILL_EVERY 10
+
+static const char * const policies[] = {"mlq", "mlfq", "fifo", "cfs", "edf"};
+static int * killed;
+static int failures;
+
+static void count(struct pcb_t * proc) {
+	killed[proc->pid]++;
+}
+
+/* Microseconds to kill the processes named "victim": one in
+ * KILL_EVERY, or all of them */
+static double run(const char * policy, int n, int all) {
+	struct os_ctx * ctx = harness_ctx(policy, BENCH_CPUS, 1, n);
+	struct pcb_t ** procs = malloc(n * sizeof(struct pcb_t *));
+	struct pcb_t * running[BENCH_CPUS];
+	int victims = 0, i;
+	uint64_t start;
+	double us;
+	killed = calloc(n + 1, sizeof(int));
+	for (i = 0; i < n; i++) {
+		procs[i] = harness_proc(i + 1);
+		procs[i]->prio = procs[i]->base_prio = i % MAX_PRIO;
+		procs[i]->priority = procs[i]->prio;
+		procs[i]->deadline = 1000 + i % 997;
+		if (all || i % KILL_EVERY == 0) {
+			strcpy(procs[i]->path, "victim");
+			victims++;
+		}
+		add_proc(procs[i]);
+	}
+	for (cur_cpu = 0; cur_cpu < BENCH_CPUS; cur_cpu++) {
+		running[cur_cpu] = get_proc();
+	}
+	cur_cpu = -1;
+	start = now_ns();
+	sched_remove_procs("victim", count);
+	us = (now_ns() - start) / 1e3;
+	for (i = 0; i < BENCH_CPUS; i++) {
+		if (running[i] != NULL && killed[running[i]->pid]) {
+			failures++;
+			fprintf(stderr, "  %s: killed pid %u on a CPU\n", policy,
+				running[i]->pid);
+		}
+		if (running[i] != NULL && strcmp(running[i]->path, "victim") == 0) {
+			victims--;
+		}
+	}
+	for (i = 1; i <= n; i++) {
+		victims -= killed[i];
+	}
+	if (victims != 0) {
+		failures++;
+		fprintf(stderr, "  %s: %d of the name left queued\n", policy,
+			victims);
+	}
+	harness_free(ctx);
+	for (i = 0; i < n; i++) {
+		if (!killed[i + 1]) {
+			free(procs[i]);
+		}
+	}
+	free(procs);
+	free(killed);
+	return us;
+}
+
+static double best(const char * policy, int n, int all) {
+	double min = 0;
+	int r;
+	for (r = 0; r < BENCH_RUNS; r++) {
+		double us = run(policy, n, all);
+		if (r == 0 || us < min) {
+			min = us;
+		}
+	}
+	return min;
+}
+
+int main(int argc, char * argv[]) {
+	static const int defaults[] = {1000, 10000};
+	int n = argc > 1 ? argc - 1 : 2;
+	int i;
+	size_t p;
+	printf("%-6s %8s %12s %12s\n", "policy", "procs", "1 in 10 us", "all us");
+	for (i = 0; i < n; i++) {
+		int nproc = argc > 1 ? atoi(argv[i + 1]) : defaults[i];
+		for (p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+			double tenth = best(policies[p], nproc, 0);
+			printf("%-6s %8d %12.1f %12.1f\n", policies[p], nproc,
+			       tenth, best(policies[p], nproc, 1));
+		}
+	}
+	if (failures != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+	return 0;
+}
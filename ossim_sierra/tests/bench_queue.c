@@ -0,0 +1,114 @@
+/* Cost of the ready queues with many processes at one priority level,
+ * on one thread:
+ *
+ *   queue_t   enqueue() of N processes, then queue_pop() of them all
+ *   ring_t    ring_push() of N, then ring_pop() of them all, past the
+ *             cells of a ring sized for the fewest and for the most
+ *   mlq       get_proc() then put_proc() of what it returned, with the
+ *             N processes all queued at priority 0
+ *
+ *   bench_queue [N...]
+ *
+ * prints the nanoseconds per operation, or per pair of them, for each
+ * N, and exits with status 1 if a queue handed the processes back out
+ * of the order they went in. Defaults: 1, 1000 and 100000 processes */
+
+#include "harness.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_ROUNDS 20
+#define BENCH_DISPATCHES 2000000
+
+static int failures;
+
+static void check(struct pcb_t * proc, int i) {
+	if (proc == NULL || proc->pid != (uint32_t)i + 1) {
+		if (failures++ < 10) {
+			fprintf(stderr, "  out of order: %d\n", i + 1);
+		}
+	}
+}
+
+/* Nanoseconds per enqueue() and queue_pop() pair */
+static double run_queue(struct pcb_t * procs, int n) {
+	struct queue_t q;
+	uint64_t start;
+	int r, i;
+	queue_init(&q);
+	start = now_ns();
+	for (r = 0; r < BENCH_ROUNDS; r++) {
+		for (i = 0; i < n; i++) {
+			enqueue(&q, &procs[i]);
+		}
+		for (i = 0; i < n; i++) {
+			check(queue_pop(&q), i);
+		}
+	}
+	double ns = (double)(now_ns() - start) / BENCH_ROUNDS / n;
+	queue_free(&q);
+	return ns;
+}
+
+/* Nanoseconds per ring_push() and ring_pop() pair */
+static double run_ring(struct pcb_t * procs, int n, int cells) {
+	struct ring_t ring;
+	uint64_t start;
+	int r, i;
+	ring_init(&ring, cells);
+	start = now_ns();
+	for (r = 0; r < BENCH_ROUNDS; r++) {
+		for (i = 0; i < n; i++) {
+			ring_push(&ring, &procs[i]);
+		}
+		for (i = 0; i < n; i++) {
+			check(ring_pop(&ring), i);
+		}
+	}
+	double ns = (double)(now_ns() - start) / BENCH_ROUNDS / n;
+	ring_destroy(&ring);
+	return ns;
+}
+
+/* Nanoseconds per dispatch. Each one puts the process back behind the
+ * others of its level, so they come out in turn */
+static double run_mlq(struct pcb_t * procs, int n) {
+	struct os_ctx * ctx = harness_ctx("mlq", 1, 0, n);
+	uint64_t start;
+	long i;
+	for (i = 0; i < n; i++) {
+		add_proc(&procs[i]);
+	}
+	start = now_ns();
+	for (i = 0; i < BENCH_DISPATCHES; i++) {
+		struct pcb_t * proc = get_proc();
+		check(proc, i % n);
+		put_proc(proc);
+	}
+	double ns = (double)(now_ns() - start) / BENCH_DISPATCHES;
+	harness_free(ctx);
+	return ns;
+}
+
+int main(int argc, char * argv[]) {
+	static const int defaults[] = {1, 1000, 100000};
+	int n = argc > 1 ? argc - 1 : 3;
+	int i;
+	printf("%8s %10s %10s %10s %10s\n", "procs", "queue_t", "ring min",
+	       "ring max", "mlq");
+	for (i = 0; i < n; i++) {
+		int nproc = argc > 1 ? atoi(argv[i + 1]) : defaults[i];
+		struct pcb_t * procs = harness_procs(nproc);
+		double queue = run_queue(procs, nproc);
+		double min = run_ring(procs, nproc, RING_MIN_CELLS);
+		double max = run_ring(procs, nproc, RING_MAX_CELLS);
+		printf("%8d %10.1f %10.1f %10.1f %10.1f\n", nproc, queue, min,
+		       max, run_mlq(procs, nproc));
+		free(procs);
+	}
+	if (failures != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+	return 0;
+}
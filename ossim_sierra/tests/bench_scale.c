@@ -0,0 +1,91 @@
+/* Dispatch throughput as CPUs are added: a thread per CPU, each one
+ * stepping its CPU (cur_cpu) through get_proc() and put_proc() of what
+ * it got as fast as it can, with 8 processes per CPU queued over the
+ * priority levels. Runs with the MLQ run queue shared by all CPUs and
+ * with one per CPU (-q).
+ *
+ *   bench_scale [POLICY [CPUS...]]
+ *
+ * prints the millions of dispatches per second. Defaults: mlq, 4, 16
+ * and 64 CPUs. The threads only run at the same time, and contend, on
+ * as many host cores as there are */
+
+#include "harness.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_PROCS_PER_CPU 8
+#define BENCH_DISPATCHES 200000	/* Per CPU */
+
+static struct os_ctx * ctx;
+static pthread_barrier_t start;
+static atomic_long dispatches;
+
+static void * cpu(void * arg) {
+	long n = 0, i;
+	cur_ctx = ctx;
+	cur_cpu = (int)(long)arg;
+	pthread_barrier_wait(&start);
+	for (i = 0; i < BENCH_DISPATCHES; i++) {
+		struct pcb_t * proc = get_proc();
+		if (proc != NULL) {
+			put_proc(proc);
+			n++;
+		}
+	}
+	atomic_fetch_add(&dispatches, n);
+	return NULL;
+}
+
+static double run(const char * policy, int cpus, int percpu) {
+	int nproc = cpus * BENCH_PROCS_PER_CPU;
+	pthread_t * thread = malloc(cpus * sizeof(pthread_t));
+	struct pcb_t * procs;
+	uint64_t t0;
+	long i;
+	ctx = harness_ctx(policy, cpus, percpu, nproc);
+	procs = harness_procs(nproc);
+	for (i = 0; i < nproc; i++) {
+		procs[i].prio = procs[i].base_prio = i % MAX_PRIO;
+		procs[i].priority = procs[i].prio;
+		add_proc(&procs[i]);
+	}
+	atomic_store(&dispatches, 0);
+	pthread_barrier_init(&start, NULL, cpus + 1);
+	for (i = 0; i < cpus; i++) {
+		pthread_create(&thread[i], NULL, cpu, (void *)i);
+	}
+	pthread_barrier_wait(&start);
+	t0 = now_ns();
+	for (i = 0; i < cpus; i++) {
+		pthread_join(thread[i], NULL);
+	}
+	double sec = (now_ns() - t0) / 1e9;
+	pthread_barrier_destroy(&start);
+	harness_free(ctx);
+	free(procs);
+	free(thread);
+	return atomic_load(&dispatches) / sec / 1e6;
+}
+
+int main(int argc, char * argv[]) {
+	static const int defaults[] = {4, 16, 64};
+	const char * policy = argc > 1 ? argv[1] : "mlq";
+	int n = argc > 2 ? argc - 2 : 3;
+	int i;
+	if (sched_find(policy) == NULL) {
+		fprintf(stderr, "No policy %s\n", policy);
+		return 1;
+	}
+	printf("%s, %ld host cores\n", policy, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%6s %12s %12s\n", "cpus", "shared M/s", "percpu M/s");
+	for (i = 0; i < n; i++) {
+		int cpus = argc > 2 ? atoi(argv[i + 2]) : defaults[i];
+		double shared = run(policy, cpus, 0);
+		printf("%6d %12.2f %12.2f\n", cpus, shared,
+		       run(policy, cpus, 1));
+	}
+	return 0;
+}
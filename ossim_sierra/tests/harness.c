@@ -0,0 +1,82 @@
+#include "harness.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+__thread struct os_ctx * cur_ctx;
+
+/* No CPU parks: the threads of a test never leave to the slot barrier */
+void wake_idle_cpu(int last_cpu, uint64_t affinity) {
+	(void)last_cpu;
+	(void)affinity;
+}
+
+struct os_ctx * harness_ctx(const char * policy, int cpus, int percpu,
+			    int nproc) {
+	struct os_ctx * ctx = calloc(1, sizeof(*ctx));
+	ctx->time_slot = 2;
+	ctx->num_cpus = cpus;
+	ctx->num_processes = nproc;
+	ctx->percpu_rq = percpu;
+	ctx->warm_tol = -1;
+	ctx->mlfq_step = -1;
+	ctx->mlfq_age = -1;
+	ctx->mlfq_boost = -1;
+	ctx->timer.wakeup = SLOT_NEVER;
+	ctx->ckpt_slot = SLOT_NEVER;
+	ctx->sched_ops = policy != NULL ? sched_find(policy) : NULL;
+	pthread_mutex_init(&ctx->mmvm_lock, NULL);
+	pthread_mutex_init(&ctx->live_lock, NULL);
+	cur_ctx = ctx;
+	if (ctx->sched_ops != NULL) {
+		init_scheduler();
+	}
+	return ctx;
+}
+
+void harness_free(struct os_ctx * ctx) {
+	cur_ctx = ctx;
+	if (ctx->sched_ops != NULL) {
+		finish_scheduler();
+		pthread_mutex_destroy(&ctx->sched.queue_lock);
+		pthread_mutex_destroy(&ctx->sched.quantum_lock);
+	}
+	pthread_mutex_destroy(&ctx->mmvm_lock);
+	pthread_mutex_destroy(&ctx->live_lock);
+	free(ctx);
+}
+
+static void init_proc(struct pcb_t * proc, uint32_t pid) {
+	proc->pid = pid;
+	snprintf(proc->path, sizeof(proc->path), "p%u", pid);
+	proc->heap_idx = -1;
+	rb_clear(&proc->cfs_node);
+#ifdef MLQ_SCHED
+	atomic_init(&proc->queued, RQ_NONE);
+#endif
+	proc->deadline = UINT64_MAX;
+	proc->affinity = AFFINITY_ANY;
+	proc->last_cpu = -1;
+	proc->first_run = UINT64_MAX;
+}
+
+struct pcb_t * harness_procs(int n) {
+	struct pcb_t * procs = calloc(n, sizeof(struct pcb_t));
+	int i;
+	for (i = 0; i < n; i++) {
+		init_proc(&procs[i], i + 1);
+	}
+	return procs;
+}
+
+struct pcb_t * harness_proc(uint32_t pid) {
+	struct pcb_t * proc = calloc(1, sizeof(struct pcb_t));
+	init_proc(proc, pid);
+	return proc;
+}
+
+uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,29 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+/* Stress tests and benchmarks of tests/ link the scheduler, queue and
+ * timer objects without os.c, and drive them from threads of their
+ * own. harness.c stands in for what os.c would provide */
+
+#include "os-ctx.h"
+#include <stdint.h>
+
+/* Silent instance of [cpus] CPUs and room for [nproc] processes, made
+ * the one of the calling thread, with the scheduler of [policy] set up
+ * (NULL to leave it out, for the timer alone). [percpu] as with -q */
+struct os_ctx * harness_ctx(const char * policy, int cpus, int percpu,
+			    int nproc);
+
+void harness_free(struct os_ctx * ctx);
+
+/* [n] processes of pids 1 to n at priority 0, as the loader leaves
+ * them, in one array */
+struct pcb_t * harness_procs(int n);
+
+/* Process [pid] alone, as sched_remove_procs() frees those it kills */
+struct pcb_t * harness_proc(uint32_t pid);
+
+/* Monotonic clock, in nanoseconds */
+uint64_t now_ns(void);
+
+#endif
@@ -0,0 +1,276 @@
+/* Stress test of the lock-free rings (queue.c) and of the MLQ run
+ * queues built on them (sched.c), with 64 threads at once.
+ *
+ * Ring: every thread pushes processes of its own and pops whatever
+ * comes, either one pop after each push, so that the ring holds about
+ * as many processes as there are threads, or one pop for two pushes, so
+ * that it runs well past its cells into the spill queue, then drains
+ * it. Each process must come out exactly once, and those of one thread
+ * in the order it pushed them, as seen by any single popper. Done with
+ * the fewest cells and with the most, which tells the cost of a push
+ * and pop within the cells from that past them.
+ *
+ * Scheduler: every thread steps a CPU through get_proc() and put_proc()
+ * at random, holding up to 4 processes at a time, while another thread
+ * keeps killing those of one name with sched_remove_procs(), which
+ * frees them. Each process must end up killed or drained from the
+ * queues afterwards, exactly once, and never be handed to two CPUs at
+ * once. Done with one shared run queue and with one per CPU.
+ *
+ *   ring_stress [THREADS [ITERATIONS]]
+ *
+ * exits with status 1 if a process was lost, duplicated or reordered.
+ * Defaults: 64 threads, 20000 iterations each */
+
+#include "harness.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+static int threads = 64;
+static long iterations = 20000;
+static pthread_barrier_t start;
+static atomic_int failures;
+
+static void fail(const char * what, uint32_t pid) {
+	if (atomic_fetch_add(&failures, 1) < 10) {
+		fprintf(stderr, "  %s: pid %u\n", what, pid);
+	}
+}
+
+/* Ring. Process [t * iterations + i] is the [i]th one thread [t]
+ * pushes; the pid is its index plus one */
+
+static struct ring_t ring;
+static struct pcb_t * ring_procs;
+static atomic_int * popped;		/* Times each one came out */
+static atomic_long pops;
+static int growing;			/* Two pushes for one pop */
+
+static void ring_got(struct pcb_t * proc, long * last) {
+	long idx = proc->pid - 1;
+	long t = idx / iterations, i = idx % iterations;
+	if (atomic_fetch_add(&popped[idx], 1) != 0) {
+		fail("popped twice", proc->pid);
+	}
+	if (i <= last[t]) {
+		fail("out of order", proc->pid);
+	}
+	last[t] = i;
+	atomic_fetch_add(&pops, 1);
+}
+
+/* A failed pop yields: on a host of fewer cores than threads, a push
+ * that has claimed a cell but not yet filled it holds up every pop
+ * behind it until its thread runs again */
+static void * ring_thread(void * arg) {
+	long t = (long)arg, pushed = 0, t_pops = 0, i;
+	long total = (long)threads * iterations;
+	long * last = malloc(threads * sizeof(long));
+	unsigned int seed = t + 1;
+	struct pcb_t * proc;
+	for (i = 0; i < threads; i++) {
+		last[i] = -1;
+	}
+	pthread_barrier_wait(&start);
+	/* Steady, a thread pops as many as it pushed, and no more, or it
+	 * would take the one another thread waits for */
+	while (pushed < iterations || (!growing && t_pops < pushed)) {
+		if (growing ? rand_r(&seed) % 3 != 0 : pushed == t_pops) {
+			ring_push(&ring, &ring_procs[t * iterations + pushed++]);
+		} else if ((proc = ring_pop(&ring)) != NULL) {
+			ring_got(proc, last);
+			t_pops++;
+		} else {
+			thrd_yield();
+		}
+	}
+	while (growing && atomic_load(&pops) < total) {
+		if ((proc = ring_pop(&ring)) != NULL) {
+			ring_got(proc, last);
+		} else {
+			thrd_yield();
+		}
+	}
+	free(last);
+	return NULL;
+}
+
+static void ring_test(int cells, int grow) {
+	long total = (long)threads * iterations, i;
+	pthread_t * thread = malloc(threads * sizeof(pthread_t));
+	uint64_t t0;
+	int lost = 0;
+	ring_procs = harness_procs(total);
+	popped = calloc(total, sizeof(atomic_int));
+	atomic_store(&pops, 0);
+	growing = grow;
+	ring_init(&ring, cells);
+	pthread_barrier_init(&start, NULL, threads + 1);
+	for (i = 0; i < threads; i++) {
+		pthread_create(&thread[i], NULL, ring_thread, (void *)i);
+	}
+	pthread_barrier_wait(&start);
+	t0 = now_ns();
+	for (i = 0; i < threads; i++) {
+		pthread_join(thread[i], NULL);
+	}
+	for (i = 0; i < total; i++) {
+		lost += atomic_load(&popped[i]) == 0;
+	}
+	if (ring_pop(&ring) != NULL) {
+		fail("left on the ring", 0);
+	}
+	printf("ring, %4zu cells, %s: %d threads, %ld processes, %.0f ns "
+	       "per push and pop, lost %d\n", ring.cells,
+	       grow ? "growing" : "steady ", threads, total,
+	       (double)(now_ns() - t0) / total, lost);
+	atomic_fetch_add(&failures, lost);
+	pthread_barrier_destroy(&start);
+	ring_destroy(&ring);
+	free(popped);
+	free(ring_procs);
+	free(thread);
+}
+
+/* Scheduler */
+
+#define HOLD_MAX 4
+#define KILL_EVERY 97		/* pids named KILL_NAME, one in so many */
+#define KILL_NAME "victim"
+
+static struct os_ctx * ctx;
+static atomic_int * held;		/* On a CPU */
+static atomic_int * killed;
+static atomic_int stop;
+
+static void kill_drop(struct pcb_t * proc) {
+	if (atomic_load(&held[proc->pid])) {
+		fail("killed on a CPU", proc->pid);
+	}
+	if (atomic_fetch_add(&killed[proc->pid], 1) != 0) {
+		fail("killed twice", proc->pid);
+	}
+}
+
+static void * cpu_thread(void * arg) {
+	struct pcb_t * mine[HOLD_MAX];
+	unsigned int seed = (long)arg + 1;
+	int n = 0;
+	long i;
+	cur_ctx = ctx;
+	cur_cpu = (int)(long)arg;
+	pthread_barrier_wait(&start);
+	for (i = 0; i < iterations || n > 0; i++) {
+		struct pcb_t * proc;
+		if (i < iterations && n < HOLD_MAX && rand_r(&seed) % 2) {
+			if ((proc = get_proc()) == NULL) {
+				thrd_yield();
+				continue;
+			}
+			if (atomic_exchange(&held[proc->pid], 1)) {
+				fail("on two CPUs", proc->pid);
+			}
+			if (atomic_load(&killed[proc->pid])) {
+				fail("dispatched once killed", proc->pid);
+			}
+			mine[n++] = proc;
+		} else if (n > 0) {
+			proc = mine[--n];
+			atomic_store(&held[proc->pid], 0);
+			put_proc(proc);
+		}
+	}
+	return NULL;
+}
+
+static void * killer_thread(void * arg) {
+	(void)arg;
+	cur_ctx = ctx;
+	pthread_barrier_wait(&start);
+	while (!atomic_load(&stop)) {
+		sched_remove_procs(KILL_NAME, kill_drop);
+		usleep(100);
+	}
+	return NULL;
+}
+
+static void sched_test(int percpu) {
+	int nproc = MAX_PRIO * 8, lost = 0, dup = 0, drained = 0, nkilled = 0;
+	pthread_t * thread = malloc(threads * sizeof(pthread_t));
+	pthread_t killer;
+	int * seen = calloc(nproc + 1, sizeof(int));
+	struct pcb_t * proc;
+	long i;
+	ctx = harness_ctx("mlq", threads, percpu, nproc);
+	held = calloc(nproc + 1, sizeof(atomic_int));
+	killed = calloc(nproc + 1, sizeof(atomic_int));
+	atomic_store(&stop, 0);
+	for (i = 0; i < nproc; i++) {
+		proc = harness_proc(i + 1);
+		proc->prio = proc->base_prio = i % MAX_PRIO;
+		if (proc->pid % KILL_EVERY == 0) {
+			strcpy(proc->path, KILL_NAME);
+		}
+		add_proc(proc);
+	}
+	pthread_barrier_init(&start, NULL, threads + 2);
+	for (i = 0; i < threads; i++) {
+		pthread_create(&thread[i], NULL, cpu_thread, (void *)i);
+	}
+	pthread_create(&killer, NULL, killer_thread, NULL);
+	pthread_barrier_wait(&start);
+	for (i = 0; i < threads; i++) {
+		pthread_join(thread[i], NULL);
+	}
+	atomic_store(&stop, 1);
+	pthread_join(killer, NULL);
+	/* What is left queued, as every CPU sees it */
+	for (cur_cpu = 0; cur_cpu < threads; cur_cpu++) {
+		while ((proc = get_proc()) != NULL) {
+			seen[proc->pid]++;
+			drained++;
+			free(proc);
+		}
+	}
+	cur_cpu = -1;
+	for (i = 1; i <= nproc; i++) {
+		int k = seen[i] + atomic_load(&killed[i]);
+		lost += k == 0;
+		dup += k > 1;
+		nkilled += atomic_load(&killed[i]);
+	}
+	printf("run queues, %s: %d CPUs, %d processes, killed %d, drained "
+	       "%d, lost %d, duplicated %d\n", percpu ? "per CPU" : "shared",
+	       threads, nproc, nkilled, drained, lost, dup);
+	atomic_fetch_add(&failures, lost + dup);
+	pthread_barrier_destroy(&start);
+	harness_free(ctx);
+	free(held);
+	free(killed);
+	free(seen);
+	free(thread);
+}
+
+int main(int argc, char * argv[]) {
+	if (argc > 1) {
+		threads = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		iterations = atol(argv[2]);
+	}
+	ring_test(RING_MIN_CELLS, 0);
+	ring_test(RING_MAX_CELLS, 0);
+	ring_test(RING_MIN_CELLS, 1);
+	ring_test(RING_MAX_CELLS, 1);
+	sched_test(0);
+	sched_test(1);
+	if (atomic_load(&failures) != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+	return 0;
+}
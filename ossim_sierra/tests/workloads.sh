@@ -0,0 +1,109 @@
+#!/bin/sh
+
+# End-to-end measurements of the simulator on the workloads of
+# input/bench/, one table each:
+#
+#   idle      CPU slots spent idle while processes were queued
+#   preempt   response of priority-0 arrivals over CPU hogs, without
+#             and with preemption on arrival (-p)
+#   quantum   makespan and dispatches of mlq under each kind of -Q
+#   mlfq      wait and response percentiles under mlq and mlfq, and
+#             where mlfq had processes spend their time
+#
+# OS names the build to measure, ./os by default, so that an older one
+# can be compared on the same workloads.
+
+set -e
+
+usage() {
+	echo >&2 "usage: $0 [TABLE...]"
+	echo >&2
+	echo >&2 "  TABLE    idle preempt quantum mlfq (all of them by default)"
+	echo >&2
+	exit 1
+}
+
+cd "$(dirname "$0")/.."
+OS=${OS:-./os}
+
+# Processes of config $1 that a -s run finishes
+finished() {
+	"$OS" -s "$1" | grep -c "has finished" || true
+}
+
+# Processes config $1 loads
+procs() {
+	head -1 "input/$1" | cut -d' ' -f3
+}
+
+idle() {
+	echo "== idle: CPU slots idle while processes were queued (idlerdy)"
+	for cfg in bench/low_prio bench/low_prio_spread; do
+		echo "-- $cfg: $(finished $cfg) of $(procs $cfg) processes finish"
+		"$OS" -S cpus=1,2,4 "$cfg" | tail -4
+	done
+}
+
+# Mean response and turnaround of the processes at priority $1, from the
+# per-priority rows of the -m report on stdin
+prio_row() {
+	awk -v p="$1" '$1 == p && NF == 6 { print $4, $5 }'
+}
+
+preempt() {
+	echo "== preempt: 8 hogs at priority 139 and 24 short jobs at 0 arriving"
+	echo "   over 400 slots on 4 CPUs, mean response of the short ones and"
+	echo "   turnaround of the hogs, in slots. No -s: a thread per CPU"
+	printf "%-8s %-10s %10s %10s %8s\n" policy flags response hogs preempts
+	for pol in mlq edf; do
+		for flags in "-s" "-s -p" "-s -q" "-s -q -p" "" "-p"; do
+			out=$("$OS" $flags -m /dev/null bench/preempt_$pol)
+			printf "%-8s %-10s %10s %10s %8s\n" $pol "${flags:-none}" \
+				$(echo "$out" | prio_row 0 | cut -d' ' -f1) \
+				$(echo "$out" | prio_row 139 | cut -d' ' -f2) \
+				$(echo "$out" | sed -n 's/^Preemptions on arrival: //p' |
+					grep . || echo 0)
+		done
+	done
+}
+
+quantum() {
+	echo "== quantum: makespan/dispatches of -s runs for each -Q SPEC"
+	printf "%-16s%20s%20s%20s%20s\n" config default linear:1:8 adaptive \
+		linear:1:8,adaptive
+	for cfg in sched sched_0 sched_1 os_1_mlq_paging bench/crunchers; do
+		printf "%-16s" $cfg
+		slot=$(head -1 "input/$cfg" | cut -d' ' -f1)
+		for spec in "" linear:1:8 adaptive linear:1:8,adaptive; do
+			"$OS" -s ${spec:+-Q $spec} -S slot=$slot $cfg | tail -1 |
+				awk '{ printf "%20s", $5 "/" $8 }'
+		done
+		echo
+	done
+}
+
+mlfq() {
+	echo "== mlfq: 4 CPU-bound processes at priority 20, 2 medium ones at 60"
+	echo "   and 24 short ones at 100-129 arriving over time, on 2 CPUs, -s"
+	for pol in mlq mlfq; do
+		out=$("$OS" -s -m /dev/null bench/feedback_$pol)
+		echo "-- $pol, slots"
+		echo "$out" | sed -n '/^Latency/,/^\tprio procs/p' |
+			grep -E '^[[:space:]]+(mean|wait|response)' | sed 's/^\t/   /'
+	done
+	echo "-- mlfq, slots spent at each ten priorities"
+	echo "$out" | grep '^MLFQ' | sed 's/^/   /'
+	echo "$out" | sed -n '/^MLFQ/,$p' | awk '
+		$1 ~ /^[0-9]+$/ { s[int($1 / 10)] += $2; n += $2 }
+		END { for (d = 0; d < 14; d++) if (s[d])
+			printf "   %3d-%-3d %7d %5.1f%%\n", d * 10, d * 10 + 9,
+				s[d], 100 * s[d] / n }'
+}
+
+tables=${*:-idle preempt quantum mlfq}
+for t in $tables; do
+	case $t in
+	idle|preempt|quantum|mlfq) $t ;;
+	*) usage ;;
+	esac
+done